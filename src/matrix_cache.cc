@@ -0,0 +1,212 @@
+#include "matrix_cache.h"
+
+#include <cstring>
+
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+
+uint64_t Mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xFF51AFD7ED558CCDULL;
+  value ^= value >> 33;
+  value *= 0xC4CEB9FE1A85EC53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+}  // namespace
+
+ResultCache::ResultCache(size_t memory_budget)
+    : memory_budget_(memory_budget), bytes_(0), hits_(0), misses_(0) {}
+
+double ResultCache::Determinant(const Matrix& matrix) {
+  uint64_t hash = Hash(matrix);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = Find(matrix, hash);
+    if (entry != nullptr && entry->has_determinant) {
+      ++hits_;
+      return entry->determinant;
+    }
+    ++misses_;
+  }
+  double determinant = matrix.Determinant();
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry* entry = Insert(matrix, hash);
+  if (entry != nullptr) {
+    entry->has_determinant = true;
+    entry->determinant = determinant;
+  }
+  return determinant;
+}
+
+Matrix ResultCache::InverseMatrix(const Matrix& matrix) {
+  uint64_t hash = Hash(matrix);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = Find(matrix, hash);
+    if (entry != nullptr && entry->has_inverse) {
+      ++hits_;
+      return entry->inverse;
+    }
+    ++misses_;
+  }
+  Matrix inverse = matrix.InverseMatrix();
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry* entry = Insert(matrix, hash);
+  if (entry != nullptr && !entry->has_inverse &&
+      entry->bytes + Bytes(inverse) <= memory_budget_) {
+    entry->has_inverse = true;
+    entry->inverse = inverse;
+    Account(*entry);
+  }
+  return inverse;
+}
+
+Matrix ResultCache::Solve(const Matrix& matrix, const Matrix& rhs) {
+  if (matrix.rows_ != matrix.cols_ || rhs.rows_ != matrix.rows_) {
+    throw std::exception();
+  }
+  uint64_t hash = Hash(matrix);
+  std::vector<double> lu;
+  std::vector<int> pivots;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = Find(matrix, hash);
+    if (entry != nullptr && !entry->pivots.empty()) {
+      ++hits_;
+      lu = entry->lu;
+      pivots = entry->pivots;
+    } else {
+      ++misses_;
+    }
+  }
+  if (pivots.empty()) {
+    matrix.Factorize(lu, pivots);
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = Insert(matrix, hash);
+    if (entry != nullptr && entry->pivots.empty() &&
+        entry->bytes + lu.size() * sizeof(double) +
+                pivots.size() * sizeof(int) <=
+            memory_budget_) {
+      entry->lu = lu;
+      entry->pivots = pivots;
+      Account(*entry);
+    }
+  }
+  return Matrix::SolveFactorized(lu, pivots, rhs);
+}
+
+size_t ResultCache::GetHits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+size_t ResultCache::GetMisses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+size_t ResultCache::GetBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+void ResultCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_.clear();
+  entries_.clear();
+  bytes_ = 0;
+}
+
+uint64_t ResultCache::Hash(const Matrix& matrix) {
+  // four independent lanes keep the multiplications pipelined and let the
+  // compiler vectorize the loop
+  uint64_t lanes[4] = {kPrime1, kPrime2, kPrime1 ^ kPrime2, ~kPrime1};
+  for (int i = 0; i < matrix.rows_; ++i) {
+    const double* row = matrix.matrix_[i];
+    int j = 0;
+    for (; j + 4 <= matrix.cols_; j += 4) {
+      for (int lane = 0; lane < 4; ++lane) {
+        uint64_t bits;
+        std::memcpy(&bits, row + j + lane, sizeof(bits));
+        lanes[lane] = (lanes[lane] ^ bits) * kPrime1;
+      }
+    }
+    for (; j < matrix.cols_; ++j) {
+      uint64_t bits;
+      std::memcpy(&bits, row + j, sizeof(bits));
+      lanes[0] = (lanes[0] ^ bits) * kPrime2;
+    }
+  }
+  uint64_t hash = (static_cast<uint64_t>(matrix.rows_) << 32) ^
+                  static_cast<uint32_t>(matrix.cols_);
+  for (uint64_t lane : lanes) hash = Mix(hash ^ lane) * kPrime2;
+  return Mix(hash);
+}
+
+ResultCache::Entry* ResultCache::Find(const Matrix& matrix, uint64_t hash) {
+  auto range = index_.equal_range(hash);
+  for (auto found = range.first; found != range.second; ++found) {
+    if (SameContents(found->second->key, matrix)) {
+      entries_.splice(entries_.begin(), entries_, found->second);
+      return &*found->second;
+    }
+  }
+  return nullptr;
+}
+
+ResultCache::Entry* ResultCache::Insert(const Matrix& matrix, uint64_t hash) {
+  Entry* existing = Find(matrix, hash);
+  if (existing != nullptr) return existing;
+  // a key larger than the whole budget is never stored
+  if (Bytes(matrix) > memory_budget_) return nullptr;
+  // the key shares its elements with the caller until one of them changes
+  entries_.push_front(
+      Entry{hash, matrix, false, 0, false, Matrix(), {}, {}, Bytes(matrix)});
+  index_.emplace(hash, entries_.begin());
+  bytes_ += entries_.front().bytes;
+  Account(entries_.front());
+  return &entries_.front();
+}
+
+void ResultCache::Account(Entry& entry) {
+  size_t bytes = Bytes(entry.key) +
+                 (entry.has_inverse ? Bytes(entry.inverse) : 0) +
+                 entry.lu.size() * sizeof(double) +
+                 entry.pivots.size() * sizeof(int);
+  bytes_ += bytes - entry.bytes;
+  entry.bytes = bytes;
+  // the entry being filled fits the budget on its own, stays at the front
+  // and is never evicted
+  while (bytes_ > memory_budget_ && entries_.size() > 1) {
+    Entry& victim = entries_.back();
+    auto range = index_.equal_range(victim.hash);
+    for (auto found = range.first; found != range.second; ++found) {
+      if (&*found->second == &victim) {
+        index_.erase(found);
+        break;
+      }
+    }
+    bytes_ -= victim.bytes;
+    entries_.pop_back();
+  }
+}
+
+bool ResultCache::SameContents(const Matrix& left, const Matrix& right) {
+  if (left.rows_ != right.rows_ || left.cols_ != right.cols_) return false;
+  if (left.matrix_ == right.matrix_) return true;
+  size_t bytes = static_cast<size_t>(left.cols_) * sizeof(double);
+  for (int i = 0; i < left.rows_; ++i) {
+    if (std::memcmp(left.matrix_[i], right.matrix_[i], bytes) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t ResultCache::Bytes(const Matrix& matrix) {
+  return static_cast<size_t>(matrix.rows_) * matrix.cols_ * sizeof(double);
+}
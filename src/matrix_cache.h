@@ -0,0 +1,64 @@
+#ifndef SRC_MATRIX_CACHE_H
+#define SRC_MATRIX_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "matrix_oop.h"
+
+// memoizes results of expensive operations by matrix contents, entries are
+// evicted least recently used first once memory_budget bytes are exceeded
+class ResultCache {
+ public:
+  explicit ResultCache(size_t memory_budget);
+  ResultCache(const ResultCache& other) = delete;
+  ResultCache& operator=(const ResultCache& other) = delete;
+
+  // cached operations, same results and exceptions as the Matrix ones
+  double Determinant(const Matrix& matrix);
+  Matrix InverseMatrix(const Matrix& matrix);
+  Matrix Solve(const Matrix& matrix, const Matrix& rhs);
+
+  // statistics
+  size_t GetHits() const;
+  size_t GetMisses() const;
+  size_t GetBytes() const;
+  void Clear();
+
+  static uint64_t Hash(const Matrix& matrix);
+
+ private:
+  struct Entry {
+    uint64_t hash;
+    Matrix key;
+    bool has_determinant;
+    double determinant;
+    bool has_inverse;
+    Matrix inverse;
+    std::vector<double> lu;
+    std::vector<int> pivots;
+    size_t bytes;
+  };
+
+  // looks the matrix up and moves it to the front, returns nullptr on a
+  // miss, Insert returns nullptr for a key that exceeds the budget alone,
+  // callers hold mutex_
+  Entry* Find(const Matrix& matrix, uint64_t hash);
+  Entry* Insert(const Matrix& matrix, uint64_t hash);
+  void Account(Entry& entry);
+
+  static bool SameContents(const Matrix& left, const Matrix& right);
+  static size_t Bytes(const Matrix& matrix);
+
+  // data members
+  size_t memory_budget_, bytes_;
+  size_t hits_, misses_;
+  std::list<Entry> entries_;
+  std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index_;
+  mutable std::mutex mutex_;
+};
+
+#endif  // SRC_MATRIX_CACHE_H
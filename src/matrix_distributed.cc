@@ -0,0 +1,421 @@
+#include "matrix_distributed.h"
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace {
+
+enum Command { kExit, kStore, kUpdate, kTake, kReset };
+
+#ifdef MSG_NOSIGNAL
+const int kSendFlags = MSG_NOSIGNAL;
+#else
+const int kSendFlags = 0;
+#endif
+
+void WriteAll(int fd, const char* buffer, size_t bytes) {
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t count = send(fd, buffer + done, bytes - done, kSendFlags);
+    if (count <= 0) {
+      throw std::exception();
+    }
+    done += count;
+  }
+}
+
+void ReadAll(int fd, char* buffer, size_t bytes) {
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t count = read(fd, buffer + done, bytes - done);
+    if (count <= 0) {
+      throw std::exception();
+    }
+    done += count;
+  }
+}
+
+}  // namespace
+
+SocketChannel::SocketChannel(int fd) : fd_(fd) {}
+
+SocketChannel::~SocketChannel() { close(fd_); }
+
+void SocketChannel::Send(const std::vector<double>& message) {
+  uint64_t size = message.size();
+  WriteAll(fd_, reinterpret_cast<const char*>(&size), sizeof(size));
+  WriteAll(fd_, reinterpret_cast<const char*>(message.data()),
+           size * sizeof(double));
+}
+
+std::vector<double> SocketChannel::Receive() {
+  uint64_t size = 0;
+  ReadAll(fd_, reinterpret_cast<char*>(&size), sizeof(size));
+  std::vector<double> message(size);
+  ReadAll(fd_, reinterpret_cast<char*>(message.data()), size * sizeof(double));
+  return message;
+}
+
+SocketTransport::SocketTransport(int workers) {
+  if (workers <= 0) {
+    throw std::exception();
+  }
+  try {
+    for (int worker = 0; worker < workers; ++worker) {
+      int fds[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        throw std::exception();
+      }
+      pid_t pid = fork();
+      if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        throw std::exception();
+      }
+      if (pid == 0) {
+        // the worker keeps only its own end of its own socket and must never
+        // return into the caller's program, whatever Serve throws
+        try {
+          close(fds[0]);
+          for (auto& channel : channels_) channel.reset();
+          SocketChannel channel(fds[1]);
+          DistributedEngine::Serve(channel);
+        } catch (...) {
+        }
+        _exit(0);
+      }
+      close(fds[1]);
+      pids_.push_back(pid);
+      channels_.push_back(std::make_unique<SocketChannel>(fds[0]));
+    }
+  } catch (...) {
+    Shutdown();
+    throw;
+  }
+}
+
+SocketTransport::~SocketTransport() { Shutdown(); }
+
+void SocketTransport::Shutdown() {
+  for (auto& channel : channels_) {
+    try {
+      channel->Send({kExit});
+    } catch (...) {
+    }
+  }
+  channels_.clear();
+  for (pid_t pid : pids_) waitpid(pid, nullptr, 0);
+  pids_.clear();
+}
+
+int SocketTransport::GetWorkers() const {
+  return static_cast<int>(channels_.size());
+}
+
+Channel& SocketTransport::GetChannel(int worker) {
+  return *channels_.at(worker);
+}
+
+DistributedEngine::DistributedEngine(Transport& transport, int block_size)
+    : transport_(transport),
+      block_size_(block_size),
+      grid_rows_(1),
+      grid_cols_(1) {
+  int workers = transport_.GetWorkers();
+  if (block_size <= 0 || workers <= 0) {
+    throw std::exception();
+  }
+  // the most square grid that uses every worker
+  grid_rows_ = static_cast<int>(std::sqrt(static_cast<double>(workers)));
+  while (workers % grid_rows_ != 0) --grid_rows_;
+  grid_cols_ = workers / grid_rows_;
+}
+
+// workers start every operation with empty block stores and drop the
+// blocks of an operation that failed, so nothing leaks into the next one
+template <typename Func>
+Matrix DistributedEngine::Guarded(Func body) {
+  Reset();
+  try {
+    return body();
+  } catch (...) {
+    try {
+      Reset();
+    } catch (...) {
+    }
+    throw;
+  }
+}
+
+Matrix DistributedEngine::MulMatrix(const Matrix& left, const Matrix& right) {
+  if (left.cols_ != right.rows_) {
+    throw std::exception();
+  }
+  return Guarded([&] {
+    int block_rows = (left.rows_ + block_size_ - 1) / block_size_;
+    int block_inner = (left.cols_ + block_size_ - 1) / block_size_;
+    int block_cols = (right.cols_ + block_size_ - 1) / block_size_;
+    // SUMMA: at step k the owners of C(i, j) receive A(i, k) for their
+    // block rows and B(k, j) for their block columns and accumulate the
+    // product, the first step overwrites
+    for (int k = 0; k < block_inner; ++k) {
+      std::vector<std::pair<int, Matrix>> panel_left, panel_right;
+      for (int i = 0; i < block_rows; ++i) {
+        panel_left.emplace_back(i, Block(left, i, k));
+      }
+      for (int j = 0; j < block_cols; ++j) {
+        panel_right.emplace_back(j, Block(right, k, j));
+      }
+      Update(1, panel_left, panel_right, k == 0);
+    }
+    std::vector<std::vector<std::pair<int, int>>> requests(
+        transport_.GetWorkers());
+    for (int i = 0; i < block_rows; ++i) {
+      for (int j = 0; j < block_cols; ++j) {
+        requests[Owner(i, j)].emplace_back(i, j);
+      }
+    }
+    Matrix result(left.rows_, right.cols_);
+    Take(requests, result);
+    return result;
+  });
+}
+
+Matrix DistributedEngine::FactorLu(const Matrix& matrix) {
+  if (matrix.rows_ != matrix.cols_) {
+    throw std::exception();
+  }
+  return Guarded([&] {
+    int count = (matrix.rows_ + block_size_ - 1) / block_size_;
+    for (int i = 0; i < count; ++i) {
+      for (int j = 0; j < count; ++j) {
+        std::vector<double> message{kStore};
+        AppendBlock(message, i, j, Block(matrix, i, j));
+        transport_.GetChannel(Owner(i, j)).Send(message);
+      }
+    }
+    // right-looking block LU: the coordinator factors panel k, which is
+    // final after its step, the owners update the trailing blocks in
+    // parallel
+    Matrix result(matrix.rows_, matrix.cols_);
+    for (int k = 0; k < count; ++k) {
+      std::vector<std::vector<std::pair<int, int>>> requests(
+          transport_.GetWorkers());
+      requests[Owner(k, k)].emplace_back(k, k);
+      for (int l = k + 1; l < count; ++l) {
+        requests[Owner(l, k)].emplace_back(l, k);
+        requests[Owner(k, l)].emplace_back(k, l);
+      }
+      Take(requests, result);
+      Matrix diagonal = Block(result, k, k);
+      Matrix::FactorTile(diagonal);
+      Place(result, k, k, diagonal);
+      std::vector<std::pair<int, Matrix>> panel_lower, panel_upper;
+      for (int l = k + 1; l < count; ++l) {
+        Matrix upper = Block(result, k, l);
+        Matrix::SolveLowerUnit(diagonal, upper);
+        Place(result, k, l, upper);
+        panel_upper.emplace_back(l, std::move(upper));
+        Matrix lower = Block(result, l, k);
+        Matrix::SolveUpper(diagonal, lower);
+        Place(result, l, k, lower);
+        panel_lower.emplace_back(l, std::move(lower));
+      }
+      Update(-1, panel_lower, panel_upper, false);
+    }
+    return result;
+  });
+}
+
+void DistributedEngine::Serve(Channel& channel) {
+  std::map<std::pair<int, int>, Matrix> blocks;
+  while (true) {
+    std::vector<double> message;
+    try {
+      message = channel.Receive();
+    } catch (...) {
+      return;
+    }
+    if (message.empty()) return;
+    Command command = static_cast<Command>(message[0]);
+    if (command == kExit) return;
+    size_t position = 1;
+    int block_row = 0, block_col = 0;
+    if (command == kStore) {
+      Matrix block = ReadBlock(message, position, block_row, block_col);
+      blocks.erase({block_row, block_col});
+      blocks.emplace(std::make_pair(block_row, block_col), std::move(block));
+    } else if (command == kReset) {
+      blocks.clear();
+    } else if (command == kUpdate) {
+      double sign = message[position++];
+      bool overwrite = message[position++] != 0;
+      int left_count = static_cast<int>(message[position++]);
+      int right_count = static_cast<int>(message[position++]);
+      std::vector<std::pair<int, Matrix>> left, right;
+      for (int l = 0; l < left_count; ++l) {
+        Matrix block = ReadBlock(message, position, block_row, block_col);
+        left.emplace_back(block_row, std::move(block));
+      }
+      for (int r = 0; r < right_count; ++r) {
+        Matrix block = ReadBlock(message, position, block_row, block_col);
+        right.emplace_back(block_col, std::move(block));
+      }
+      for (const auto& a : left) {
+        for (const auto& b : right) {
+          Matrix product =
+              Matrix::MultiplyChain({std::cref(a.second), std::cref(b.second)});
+          product.MulNumber(sign);
+          auto found = blocks.find({a.first, b.first});
+          if (found != blocks.end() && overwrite) {
+            found->second = std::move(product);
+          } else if (found == blocks.end()) {
+            blocks.emplace(std::make_pair(a.first, b.first),
+                           std::move(product));
+          } else {
+            found->second += product;
+          }
+        }
+      }
+    } else if (command == kTake) {
+      int count = static_cast<int>(message[position++]);
+      std::vector<double> reply{static_cast<double>(count)};
+      for (int b = 0; b < count; ++b) {
+        block_row = static_cast<int>(message[position++]);
+        block_col = static_cast<int>(message[position++]);
+        auto found = blocks.find({block_row, block_col});
+        if (found == blocks.end()) return;
+        AppendBlock(reply, block_row, block_col, found->second);
+        blocks.erase(found);
+      }
+      channel.Send(reply);
+    } else {
+      return;
+    }
+  }
+}
+
+int DistributedEngine::Owner(int block_row, int block_col) const {
+  return (block_row % grid_rows_) * grid_cols_ + block_col % grid_cols_;
+}
+
+Matrix DistributedEngine::Block(const Matrix& matrix, int block_row,
+                                int block_col) const {
+  int first_row = block_row * block_size_;
+  int first_col = block_col * block_size_;
+  int rows = std::min(block_size_, matrix.rows_ - first_row);
+  int cols = std::min(block_size_, matrix.cols_ - first_col);
+  Matrix block(rows, cols, Matrix::Allocation::kHeap);
+  for (int i = 0; i < rows; ++i) {
+    const double* source = matrix.matrix_[first_row + i] + first_col;
+    std::copy(source, source + cols, block.matrix_[i]);
+  }
+  return block;
+}
+
+void DistributedEngine::Place(Matrix& matrix, int block_row, int block_col,
+                              const Matrix& block) const {
+  for (int i = 0; i < block.rows_; ++i) {
+    std::copy(block.matrix_[i], block.matrix_[i] + block.cols_,
+              matrix.matrix_[block_row * block_size_ + i] +
+                  block_col * block_size_);
+  }
+}
+
+void DistributedEngine::Reset() {
+  for (int worker = 0; worker < transport_.GetWorkers(); ++worker) {
+    transport_.GetChannel(worker).Send({kReset});
+  }
+}
+
+void DistributedEngine::Update(
+    double sign, const std::vector<std::pair<int, Matrix>>& left,
+    const std::vector<std::pair<int, Matrix>>& right, bool overwrite) {
+  for (int row = 0; row < grid_rows_; ++row) {
+    for (int col = 0; col < grid_cols_; ++col) {
+      std::vector<const std::pair<int, Matrix>*> mine_left, mine_right;
+      for (const auto& entry : left) {
+        if (entry.first % grid_rows_ == row) mine_left.push_back(&entry);
+      }
+      for (const auto& entry : right) {
+        if (entry.first % grid_cols_ == col) mine_right.push_back(&entry);
+      }
+      if (mine_left.empty() || mine_right.empty()) continue;
+      std::vector<double> message{kUpdate, sign,
+                                  static_cast<double>(overwrite),
+                                  static_cast<double>(mine_left.size()),
+                                  static_cast<double>(mine_right.size())};
+      for (const auto* entry : mine_left) {
+        AppendBlock(message, entry->first, 0, entry->second);
+      }
+      for (const auto* entry : mine_right) {
+        AppendBlock(message, 0, entry->first, entry->second);
+      }
+      transport_.GetChannel(row * grid_cols_ + col).Send(message);
+    }
+  }
+}
+
+void DistributedEngine::Take(
+    const std::vector<std::vector<std::pair<int, int>>>& requests,
+    Matrix& result) {
+  for (size_t worker = 0; worker < requests.size(); ++worker) {
+    if (requests[worker].empty()) continue;
+    std::vector<double> message{kTake,
+                                static_cast<double>(requests[worker].size())};
+    for (const auto& request : requests[worker]) {
+      message.push_back(request.first);
+      message.push_back(request.second);
+    }
+    transport_.GetChannel(worker).Send(message);
+  }
+  for (size_t worker = 0; worker < requests.size(); ++worker) {
+    if (requests[worker].empty()) continue;
+    std::vector<double> reply = transport_.GetChannel(worker).Receive();
+    size_t position = 1;
+    for (size_t b = 0; b < requests[worker].size(); ++b) {
+      if (position >= reply.size()) {
+        throw std::exception();
+      }
+      int block_row = 0, block_col = 0;
+      Matrix block = ReadBlock(reply, position, block_row, block_col);
+      Place(result, block_row, block_col, block);
+    }
+  }
+}
+
+void DistributedEngine::AppendBlock(std::vector<double>& message,
+                                    int block_row, int block_col,
+                                    const Matrix& block) {
+  message.push_back(block_row);
+  message.push_back(block_col);
+  message.push_back(block.rows_);
+  message.push_back(block.cols_);
+  for (int i = 0; i < block.rows_; ++i) {
+    message.insert(message.end(), block.matrix_[i],
+                   block.matrix_[i] + block.cols_);
+  }
+}
+
+Matrix DistributedEngine::ReadBlock(const std::vector<double>& message,
+                                    size_t& position, int& block_row,
+                                    int& block_col) {
+  block_row = static_cast<int>(message[position++]);
+  block_col = static_cast<int>(message[position++]);
+  int rows = static_cast<int>(message[position++]);
+  int cols = static_cast<int>(message[position++]);
+  Matrix block(rows, cols, Matrix::Allocation::kHeap);
+  for (int i = 0; i < rows; ++i) {
+    std::copy(message.begin() + position, message.begin() + position + cols,
+              block.matrix_[i]);
+    position += cols;
+  }
+  return block;
+}
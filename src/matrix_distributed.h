@@ -0,0 +1,103 @@
+#ifndef SRC_MATRIX_DISTRIBUTED_H
+#define SRC_MATRIX_DISTRIBUTED_H
+
+#include <sys/types.h>
+
+#include <memory>
+#include <vector>
+
+#include "matrix_oop.h"
+
+// one end of a message channel between the coordinator and a worker
+class Channel {
+ public:
+  virtual ~Channel() = default;
+  virtual void Send(const std::vector<double>& message) = 0;
+  virtual std::vector<double> Receive() = 0;
+};
+
+// set of workers reachable from the coordinator, every worker runs
+// DistributedEngine::Serve on its end of the channel
+class Transport {
+ public:
+  virtual ~Transport() = default;
+  virtual int GetWorkers() const = 0;
+  virtual Channel& GetChannel(int worker) = 0;
+};
+
+class SocketChannel : public Channel {
+ public:
+  explicit SocketChannel(int fd);
+  SocketChannel(const SocketChannel& other) = delete;
+  SocketChannel& operator=(const SocketChannel& other) = delete;
+  ~SocketChannel() override;
+
+  void Send(const std::vector<double>& message) override;
+  std::vector<double> Receive() override;
+
+ private:
+  int fd_;
+};
+
+// forks the workers and connects them with Unix domain socket pairs, must
+// be created while the process has a single thread
+class SocketTransport : public Transport {
+ public:
+  explicit SocketTransport(int workers);
+  SocketTransport(const SocketTransport& other) = delete;
+  SocketTransport& operator=(const SocketTransport& other) = delete;
+  ~SocketTransport() override;
+
+  int GetWorkers() const override;
+  Channel& GetChannel(int worker) override;
+
+ private:
+  // asks the workers to exit, closes the channels and reaps the processes
+  void Shutdown();
+
+  std::vector<std::unique_ptr<SocketChannel>> channels_;
+  std::vector<pid_t> pids_;
+};
+
+// splits matrices into block_size blocks distributed block-cyclically over
+// a 2D grid of workers
+class DistributedEngine {
+ public:
+  DistributedEngine(Transport& transport, int block_size);
+
+  // operations, LU is returned packed as unit lower L and upper U without
+  // pivoting
+  Matrix MulMatrix(const Matrix& left, const Matrix& right);
+  Matrix FactorLu(const Matrix& matrix);
+
+  // worker loop, returns when the coordinator closes the channel
+  static void Serve(Channel& channel);
+
+ private:
+  int Owner(int block_row, int block_col) const;
+  Matrix Block(const Matrix& matrix, int block_row, int block_col) const;
+  void Place(Matrix& matrix, int block_row, int block_col,
+             const Matrix& block) const;
+  template <typename Func>
+  Matrix Guarded(Func body);
+  void Reset();
+  // adds sign * left * right to the owners' blocks, or replaces them when
+  // overwrite is set
+  void Update(double sign, const std::vector<std::pair<int, Matrix>>& left,
+              const std::vector<std::pair<int, Matrix>>& right,
+              bool overwrite);
+  void Take(const std::vector<std::vector<std::pair<int, int>>>& requests,
+            Matrix& result);
+
+  static void AppendBlock(std::vector<double>& message, int block_row,
+                          int block_col, const Matrix& block);
+  static Matrix ReadBlock(const std::vector<double>& message, size_t& position,
+                          int& block_row, int& block_col);
+
+  // data members
+  Transport& transport_;
+  int block_size_;
+  int grid_rows_, grid_cols_;
+};
+
+#endif  // SRC_MATRIX_DISTRIBUTED_H
@@ -0,0 +1,373 @@
+#include "matrix_expression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+Expression::Expression(ExpressionGraph* graph, int node)
+    : graph_(graph), node_(node) {}
+
+Expression Expression::operator+(const Expression& other) const {
+  if (graph_ != other.graph_) {
+    throw std::exception();
+  }
+  return Expression(graph_,
+                    graph_->Record(ExpressionGraph::Operation::kSum, node_,
+                                   other.node_, 0));
+}
+
+Expression Expression::operator-(const Expression& other) const {
+  if (graph_ != other.graph_) {
+    throw std::exception();
+  }
+  return Expression(graph_,
+                    graph_->Record(ExpressionGraph::Operation::kSub, node_,
+                                   other.node_, 0));
+}
+
+Expression Expression::operator*(const Expression& other) const {
+  if (graph_ != other.graph_) {
+    throw std::exception();
+  }
+  return Expression(graph_,
+                    graph_->Record(ExpressionGraph::Operation::kMulMatrix,
+                                   node_, other.node_, 0));
+}
+
+Expression Expression::operator*(double number) const {
+  return Expression(graph_,
+                    graph_->Record(ExpressionGraph::Operation::kMulNumber,
+                                   node_, -1, number));
+}
+
+Expression operator*(const double number, const Expression& other) {
+  return other * number;
+}
+
+Expression Expression::Transpose() const {
+  return Expression(graph_,
+                    graph_->Record(ExpressionGraph::Operation::kTranspose,
+                                   node_, -1, 0));
+}
+
+Matrix Expression::Evaluate() const { return graph_->Evaluate(*this); }
+
+int Expression::GetRows() const { return graph_->nodes_[node_].rows; }
+
+int Expression::GetCols() const { return graph_->nodes_[node_].cols; }
+
+Expression ExpressionGraph::Input(const Matrix& matrix) {
+  inputs_.push_back(matrix);
+  nodes_.push_back({Operation::kInput, static_cast<int>(inputs_.size()) - 1,
+                    -1, 0, matrix.rows_, matrix.cols_});
+  return Expression(this, static_cast<int>(nodes_.size()) - 1);
+}
+
+int ExpressionGraph::Record(Operation operation, int left, int right,
+                            double number) {
+  const Node& a = nodes_[left];
+  int rows = a.rows, cols = a.cols;
+  if (operation == Operation::kSum || operation == Operation::kSub) {
+    if (a.rows != nodes_[right].rows || a.cols != nodes_[right].cols) {
+      throw std::exception();
+    }
+    // addition is commutative, so a + b and b + a share one node
+    if (operation == Operation::kSum && right < left) std::swap(left, right);
+  } else if (operation == Operation::kMulMatrix) {
+    if (a.cols != nodes_[right].rows) {
+      throw std::exception();
+    }
+    cols = nodes_[right].cols;
+  } else if (operation == Operation::kTranspose) {
+    std::swap(rows, cols);
+  }
+  auto key = std::make_tuple(operation, left, right, number);
+  auto found = recorded_.find(key);
+  if (found != recorded_.end()) {
+    return found->second;
+  }
+  nodes_.push_back({operation, left, right, number, rows, cols});
+  int node = static_cast<int>(nodes_.size()) - 1;
+  recorded_.emplace(key, node);
+  return node;
+}
+
+bool ExpressionGraph::IsElementwise(int node) const {
+  Operation operation = nodes_[node].operation;
+  return operation == Operation::kSum || operation == Operation::kSub ||
+         operation == Operation::kMulNumber;
+}
+
+int ExpressionGraph::GetNodesCount() const {
+  return static_cast<int>(nodes_.size());
+}
+
+Matrix ExpressionGraph::Evaluate(const Expression& expression) {
+  return std::move(Evaluate(std::vector<Expression>{expression})[0]);
+}
+
+std::vector<Matrix> ExpressionGraph::Evaluate(
+    const std::vector<Expression>& expressions) {
+  int count = static_cast<int>(nodes_.size());
+  std::vector<int> users(count, 0), consumer(count, -1);
+  std::vector<bool> reachable(count, false), output(count, false);
+  std::vector<int> stack;
+  for (const Expression& expression : expressions) {
+    if (expression.graph_ != this) {
+      throw std::exception();
+    }
+    output[expression.node_] = true;
+    if (!reachable[expression.node_]) {
+      reachable[expression.node_] = true;
+      stack.push_back(expression.node_);
+    }
+  }
+  while (!stack.empty()) {
+    int node = stack.back();
+    stack.pop_back();
+    const Node& current = nodes_[node];
+    if (current.operation == Operation::kInput) continue;
+    for (int child : {current.left, current.right}) {
+      if (child < 0) continue;
+      ++users[child];
+      consumer[child] = node;
+      if (!reachable[child]) {
+        reachable[child] = true;
+        stack.push_back(child);
+      }
+    }
+  }
+
+  // an element-wise node consumed only by another element-wise node is
+  // fused into it, a product consumed only by another product joins its
+  // chain, everything else gets its own buffer
+  std::vector<bool> materialized(count, false);
+  for (int node = 0; node < count; ++node) {
+    if (!reachable[node] || nodes_[node].operation == Operation::kInput) {
+      continue;
+    }
+    bool inlined = false;
+    if (users[node] == 1 && !output[node]) {
+      int parent = consumer[node];
+      inlined = (IsElementwise(node) && IsElementwise(parent)) ||
+                (nodes_[node].operation == Operation::kMulMatrix &&
+                 nodes_[parent].operation == Operation::kMulMatrix);
+    }
+    materialized[node] = !inlined;
+  }
+
+  // dependencies and levels, node ids are already in topological order
+  std::vector<std::vector<Step>> programs(count);
+  std::vector<std::vector<int>> dependencies(count);
+  std::vector<int> level(count, 0), remaining(count, 0);
+  int levels = 0;
+  for (int node = 0; node < count; ++node) {
+    if (!materialized[node]) continue;
+    std::vector<int>& deps = dependencies[node];
+    if (IsElementwise(node)) {
+      Fuse(node, materialized, programs[node]);
+      for (const Step& step : programs[node]) {
+        if (step.operation == Operation::kInput) deps.push_back(step.node);
+      }
+    } else if (nodes_[node].operation == Operation::kMulMatrix) {
+      Flatten(node, materialized, deps);
+    } else {
+      deps.push_back(nodes_[node].left);
+    }
+    std::sort(deps.begin(), deps.end());
+    deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+    for (int dep : deps) {
+      level[node] = std::max(level[node], level[dep] + 1);
+      ++remaining[dep];
+    }
+    if (output[node]) ++remaining[node];
+    levels = std::max(levels, level[node]);
+  }
+
+  // level by level execution, buffers of finished intermediates go back to
+  // a pool and are handed to later nodes of the same shape
+  std::map<int, Matrix> values;
+  std::multimap<std::pair<int, int>, Matrix> pool;
+  bool threaded = std::thread::hardware_concurrency() > 1;
+  for (int current = 1; current <= levels; ++current) {
+    std::vector<int> tasks;
+    for (int node = 0; node < count; ++node) {
+      if (materialized[node] && level[node] == current) tasks.push_back(node);
+    }
+    for (int node : tasks) {
+      auto shape = std::make_pair(nodes_[node].rows, nodes_[node].cols);
+      auto reused = pool.find(shape);
+      if (reused != pool.end()) {
+        values.emplace(node, std::move(reused->second));
+        pool.erase(reused);
+      } else {
+        values.emplace(node, Matrix(shape.first, shape.second));
+      }
+    }
+    auto run = [&](int node) {
+      Matrix& result = values.at(node);
+      if (IsElementwise(node)) {
+        std::vector<const Matrix*> loads;
+        for (const Step& step : programs[node]) {
+          loads.push_back(step.operation == Operation::kInput
+                              ? &Value(step.node, values)
+                              : nullptr);
+        }
+        RunProgram(programs[node], loads, result);
+      } else if (nodes_[node].operation == Operation::kMulMatrix) {
+        std::vector<std::reference_wrapper<const Matrix>> operands;
+        std::vector<int> chain;
+        Flatten(node, materialized, chain);
+        for (int operand : chain) operands.push_back(Value(operand, values));
+        Matrix::MultiplyChain(operands, result);
+      } else {
+        TransposeInto(Value(nodes_[node].left, values), result);
+      }
+    };
+    if (threaded && tasks.size() > 1) {
+      // at most one worker per hardware thread, each pulls the next task
+      // of the level until none is left
+      size_t count = std::min<size_t>(
+          tasks.size(), std::max(1u, std::thread::hardware_concurrency()));
+      std::atomic<size_t> next(0);
+      std::exception_ptr failure;
+      std::mutex failure_mutex;
+      std::vector<std::thread> workers;
+      for (size_t worker = 0; worker < count; ++worker) {
+        workers.emplace_back([&] {
+          for (size_t task = next++; task < tasks.size(); task = next++) {
+            try {
+              run(tasks[task]);
+            } catch (...) {
+              std::lock_guard<std::mutex> lock(failure_mutex);
+              if (!failure) failure = std::current_exception();
+            }
+          }
+        });
+      }
+      for (auto& worker : workers) worker.join();
+      if (failure) std::rethrow_exception(failure);
+    } else {
+      for (int node : tasks) run(node);
+    }
+    for (int node : tasks) {
+      for (int dep : dependencies[node]) {
+        if (materialized[dep] && --remaining[dep] == 0) {
+          auto released = values.find(dep);
+          pool.emplace(std::make_pair(nodes_[dep].rows, nodes_[dep].cols),
+                       std::move(released->second));
+          values.erase(released);
+        }
+      }
+    }
+  }
+
+  std::vector<Matrix> results;
+  for (size_t i = 0; i < expressions.size(); ++i) {
+    int node = expressions[i].node_;
+    size_t first = 0;
+    while (expressions[first].node_ != node) ++first;
+    if (first < i) {
+      results.push_back(results[first]);
+    } else if (nodes_[node].operation == Operation::kInput) {
+      results.push_back(inputs_[nodes_[node].left]);
+    } else {
+      results.push_back(std::move(values.at(node)));
+    }
+  }
+  return results;
+}
+
+void ExpressionGraph::Fuse(int node, const std::vector<bool>& materialized,
+                           std::vector<Step>& program) const {
+  const Node& current = nodes_[node];
+  for (int child : {current.left, current.right}) {
+    if (child < 0) continue;
+    if (IsElementwise(child) && !materialized[child]) {
+      Fuse(child, materialized, program);
+    } else {
+      program.push_back({Operation::kInput, child, 0});
+    }
+  }
+  program.push_back({current.operation, -1, current.number});
+}
+
+void ExpressionGraph::Flatten(int node, const std::vector<bool>& materialized,
+                              std::vector<int>& operands) const {
+  const Node& current = nodes_[node];
+  for (int child : {current.left, current.right}) {
+    if (nodes_[child].operation == Operation::kMulMatrix &&
+        !materialized[child]) {
+      Flatten(child, materialized, operands);
+    } else {
+      operands.push_back(child);
+    }
+  }
+}
+
+const Matrix& ExpressionGraph::Value(
+    int node, const std::map<int, Matrix>& values) const {
+  if (nodes_[node].operation == Operation::kInput) {
+    return inputs_[nodes_[node].left];
+  }
+  return values.at(node);
+}
+
+void ExpressionGraph::RunProgram(const std::vector<Step>& program,
+                                 const std::vector<const Matrix*>& loads,
+                                 Matrix& result) {
+  result.Detach();
+  int cols = result.cols_;
+  size_t depth = program.size();
+  std::vector<std::vector<double>> scratch(depth, std::vector<double>(cols));
+  std::vector<const double*> stack(depth);
+  for (int i = 0; i < result.rows_; ++i) {
+    size_t top = 0;
+    for (size_t k = 0; k < depth; ++k) {
+      const Step& step = program[k];
+      if (step.operation == Operation::kInput) {
+        stack[top++] = loads[k]->matrix_[i];
+        continue;
+      }
+      if (step.operation == Operation::kMulNumber) {
+        const double* a = stack[top - 1];
+        double* out =
+            (k + 1 == depth) ? result.matrix_[i] : scratch[top - 1].data();
+        for (int j = 0; j < cols; ++j) out[j] = a[j] * step.number;
+        stack[top - 1] = out;
+      } else {
+        const double* a = stack[top - 2];
+        const double* b = stack[top - 1];
+        double* out =
+            (k + 1 == depth) ? result.matrix_[i] : scratch[top - 2].data();
+        if (step.operation == Operation::kSum) {
+          for (int j = 0; j < cols; ++j) out[j] = a[j] + b[j];
+        } else {
+          for (int j = 0; j < cols; ++j) out[j] = a[j] - b[j];
+        }
+        stack[top - 2] = out;
+        --top;
+      }
+    }
+  }
+}
+
+void ExpressionGraph::TransposeInto(const Matrix& source, Matrix& result) {
+  result.Detach();
+  const int block = 32;
+  for (int ib = 0; ib < source.rows_; ib += block) {
+    for (int jb = 0; jb < source.cols_; jb += block) {
+      int i_end = std::min(ib + block, source.rows_);
+      int j_end = std::min(jb + block, source.cols_);
+      for (int i = ib; i < i_end; ++i) {
+        for (int j = jb; j < j_end; ++j) {
+          result.matrix_[j][i] = source.matrix_[i][j];
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef SRC_MATRIX_EXPRESSION_H
+#define SRC_MATRIX_EXPRESSION_H
+
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "matrix_oop.h"
+
+class ExpressionGraph;
+
+// handle to a deferred operation recorded in an ExpressionGraph, the graph
+// must outlive every expression created from it
+class Expression {
+ public:
+  // overloads
+  Expression operator+(const Expression& other) const;
+  Expression operator-(const Expression& other) const;
+  Expression operator*(const Expression& other) const;
+  Expression operator*(double number) const;
+  friend Expression operator*(const double number, const Expression& other);
+
+  // operations
+  Expression Transpose() const;
+  Matrix Evaluate() const;
+
+  // accessors
+  int GetRows() const;
+  int GetCols() const;
+
+ private:
+  friend class ExpressionGraph;
+  Expression(ExpressionGraph* graph, int node);
+
+  ExpressionGraph* graph_;
+  int node_;
+};
+
+class ExpressionGraph {
+ public:
+  // recording
+  Expression Input(const Matrix& matrix);
+
+  // evaluation
+  Matrix Evaluate(const Expression& expression);
+  std::vector<Matrix> Evaluate(const std::vector<Expression>& expressions);
+
+  // accessors
+  int GetNodesCount() const;
+
+ private:
+  friend class Expression;
+
+  enum class Operation {
+    kInput,
+    kSum,
+    kSub,
+    kMulNumber,
+    kMulMatrix,
+    kTranspose
+  };
+
+  struct Node {
+    Operation operation;
+    int left, right;
+    double number;
+    int rows, cols;
+  };
+
+  // one instruction of a fused element-wise program, kInput loads a row of
+  // an input or of an already evaluated node
+  struct Step {
+    Operation operation;
+    int node;
+    double number;
+  };
+
+  int Record(Operation operation, int left, int right, double number);
+  bool IsElementwise(int node) const;
+  void Fuse(int node, const std::vector<bool>& materialized,
+            std::vector<Step>& program) const;
+  void Flatten(int node, const std::vector<bool>& materialized,
+               std::vector<int>& operands) const;
+  const Matrix& Value(int node, const std::map<int, Matrix>& values) const;
+
+  // kernels writing into preallocated results
+  static void RunProgram(const std::vector<Step>& program,
+                         const std::vector<const Matrix*>& loads,
+                         Matrix& result);
+  static void TransposeInto(const Matrix& source, Matrix& result);
+
+  // data members
+  std::vector<Node> nodes_;
+  std::vector<Matrix> inputs_;
+  std::map<std::tuple<Operation, int, int, double>, int> recorded_;
+};
+
+#endif  // SRC_MATRIX_EXPRESSION_H
@@ -1,53 +1,402 @@
 #include "matrix_oop.h"
 
-Matrix::Matrix() : rows_(1), cols_(1), matrix_(nullptr) {
-  matrix_ = new double*[rows_]();
-  matrix_[0] = new double[cols_]();
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t kHugePageBytes = 2UL << 20;
+
+std::atomic<Matrix::Allocation> default_allocation(Matrix::Allocation::kAuto);
+
+// minimal amount of scalar work per call before the loop is split across
+// hardware threads
+const long kParallelWork = 1L << 15;
+
+// chunk c of every split runs on the c-th CPU the process may use, so the
+// thread that first touches the rows of a chunk and the threads that later
+// compute on them share a CPU and its memory node; splits over the same
+// row range line up exactly, shifting ranges like the trailing rows of LU
+// only approximately
+void PinToChunk(int chunk) {
+  static const std::vector<int> cpus = [] {
+    std::vector<int> allowed;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(getpid(), sizeof(set), &set) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) allowed.push_back(cpu);
+      }
+    }
+    return allowed;
+  }();
+  if (cpus.size() < 2) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpus[chunk % cpus.size()], &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
 }
 
-Matrix::Matrix(int rows, int cols)
-    : rows_(rows), cols_(cols), matrix_(nullptr) {
-  if (rows <= 0 || cols <= 0) {
-    throw std::exception();
+template <typename Func>
+void ParallelFor(int begin, int end, long work, Func func) {
+  int count = end - begin;
+  int threads = static_cast<int>(std::thread::hardware_concurrency());
+  if (threads < 2 || count < 2 || work < kParallelWork) {
+    for (int i = begin; i < end; ++i) func(i);
+    return;
   }
-  matrix_ = new double*[rows_]();
-  for (int i = 0; i < rows_; ++i) {
-    matrix_[i] = new double[cols_]();
+  threads = std::min(threads, count);
+  int chunk = (count + threads - 1) / threads;
+  std::vector<std::thread> pool;
+  for (int first = begin; first < end; first += chunk) {
+    int last = std::min(first + chunk, end);
+    int index = (first - begin) / chunk;
+    pool.emplace_back([first, last, index, &func] {
+      PinToChunk(index);
+      for (int i = first; i < last; ++i) func(i);
+    });
   }
+  for (auto& thread : pool) thread.join();
 }
 
-Matrix::Matrix(const Matrix& other)
-    : rows_(other.rows_), cols_(other.cols_) {
-  matrix_ = new double*[rows_];
-  for (int i = 0; i < rows_; ++i) {
-    matrix_[i] = new double[cols_];
+// result = left * right on row pointers, the rows of result are overwritten
+void MultiplyRows(const double* const* left, const double* const* right,
+                  double* const* result, int rows, int inner, int cols) {
+  for (int i = 0; i < rows; ++i) {
+    double* out = result[i];
+    std::fill(out, out + cols, 0.0);
+    for (int k = 0; k < inner; ++k) {
+      double a = left[i][k];
+      const double* b = right[k];
+      for (int j = 0; j < cols; ++j) out[j] += a * b[j];
+    }
   }
-  for (int i = 0; i < rows_; ++i) {
-    for (int j = 0; j < cols_; ++j) {
-      matrix_[i][j] = other.matrix_[i][j];
+}
+
+// in-place LU factorization with partial pivoting of a row-major n x n
+// block, returns false for a singular matrix
+template <typename T>
+bool FactorLu(std::vector<T>& lu, std::vector<int>& pivots, int n) {
+  pivots.resize(n);
+  for (int k = 0; k < n; ++k) {
+    int pivot = k;
+    for (int i = k + 1; i < n; ++i) {
+      if (std::abs(lu[i * n + k]) > std::abs(lu[pivot * n + k])) pivot = i;
+    }
+    pivots[k] = pivot;
+    if (lu[pivot * n + k] == T(0)) return false;
+    if (pivot != k) {
+      std::swap_ranges(lu.begin() + k * n, lu.begin() + (k + 1) * n,
+                       lu.begin() + pivot * n);
     }
+    const T* row_k = lu.data() + k * n;
+    ParallelFor(k + 1, n, static_cast<long>(n - k) * (n - k), [&](int i) {
+      T* row_i = lu.data() + i * n;
+      T factor = row_i[k] / row_k[k];
+      row_i[k] = factor;
+      for (int j = k + 1; j < n; ++j) row_i[j] -= factor * row_k[j];
+    });
+  }
+  return true;
+}
+
+// overwrites column with the solution of LU * x = column
+template <typename T>
+void SolveLu(const std::vector<T>& lu, const std::vector<int>& pivots, int n,
+             std::vector<T>& column) {
+  for (int k = 0; k < n; ++k) std::swap(column[k], column[pivots[k]]);
+  for (int i = 0; i < n; ++i) {
+    T sum = column[i];
+    for (int j = 0; j < i; ++j) sum -= lu[i * n + j] * column[j];
+    column[i] = sum;
+  }
+  for (int i = n - 1; i >= 0; --i) {
+    T sum = column[i];
+    for (int j = i + 1; j < n; ++j) sum -= lu[i * n + j] * column[j];
+    column[i] = sum / lu[i * n + i];
+  }
+}
+
+template <typename T>
+void SolveColumns(const std::vector<T>& lu, const std::vector<int>& pivots,
+                  int n, const double* const* rhs, double* const* result,
+                  int cols) {
+  std::vector<T> column(n);
+  for (int c = 0; c < cols; ++c) {
+    for (int i = 0; i < n; ++i) column[i] = static_cast<T>(rhs[i][c]);
+    SolveLu(lu, pivots, n, column);
+    for (int i = 0; i < n; ++i) result[i][c] = column[i];
+  }
+}
+
+double MaxAbs(const double* const* rows, int rows_number, int cols_number) {
+  double result = 0;
+  for (int i = 0; i < rows_number; ++i) {
+    for (int j = 0; j < cols_number; ++j) {
+      result = std::max(result, std::fabs(rows[i][j]));
+    }
+  }
+  return result;
+}
+
+// rows are split like in ParallelFor, every chunk reduces into its own
+// partial and the partials are merged in chunk order
+template <typename T, typename Func, typename Merge>
+T ParallelReduce(int count, long work, const T& identity, Func func,
+                 Merge merge) {
+  int threads = static_cast<int>(std::thread::hardware_concurrency());
+  if (threads < 2 || count < 2 || work < kParallelWork) {
+    T result = identity;
+    for (int i = 0; i < count; ++i) func(i, result);
+    return result;
+  }
+  threads = std::min(threads, count);
+  int chunk = (count + threads - 1) / threads;
+  std::vector<T> partials((count + chunk - 1) / chunk, identity);
+  std::vector<std::thread> pool;
+  for (int first = 0; first < count; first += chunk) {
+    int last = std::min(first + chunk, count);
+    int index = first / chunk;
+    T& partial = partials[index];
+    pool.emplace_back([first, last, index, &func, &partial] {
+      PinToChunk(index);
+      for (int i = first; i < last; ++i) func(i, partial);
+    });
+  }
+  for (auto& thread : pool) thread.join();
+  T result = partials[0];
+  for (size_t k = 1; k < partials.size(); ++k) merge(result, partials[k]);
+  return result;
+}
+
+// error-free transformation sum + value = new sum + error
+inline void TwoSum(double& sum, double& error, double value) {
+  double total = sum + value;
+  double part = total - sum;
+  error += (sum - (total - part)) + (value - part);
+  sum = total;
+}
+
+// compensated sum kept in four lanes, so consecutive additions do not
+// depend on each other and the loop can be vectorized
+struct CompensatedSum {
+  double sums[4] = {0, 0, 0, 0};
+  double errors[4] = {0, 0, 0, 0};
+
+  template <typename Transform>
+  void Add(const double* values, int count, Transform transform) {
+    int j = 0;
+    for (; j + 4 <= count; j += 4) {
+      for (int lane = 0; lane < 4; ++lane) {
+        TwoSum(sums[lane], errors[lane], transform(values[j + lane]));
+      }
+    }
+    for (; j < count; ++j) TwoSum(sums[0], errors[0], transform(values[j]));
+  }
+
+  void Merge(const CompensatedSum& other) {
+    for (int lane = 0; lane < 4; ++lane) {
+      TwoSum(sums[lane], errors[lane], other.sums[lane]);
+      errors[lane] += other.errors[lane];
+    }
+  }
+
+  double Total() const {
+    double sum = 0, error = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+      TwoSum(sum, error, sums[lane]);
+      error += errors[lane];
+    }
+    // the error terms of an infinite sum are NaN
+    return std::isfinite(sum) ? sum + error : sum;
+  }
+};
+
+// extremum and its row-major position, index -1 until a value is seen
+struct Extremum {
+  double value;
+  long index;
+};
+
+template <typename Better>
+void MergeExtremum(Extremum& best, const Extremum& other, Better better) {
+  if (other.index >= 0 &&
+      (best.index < 0 || better(other.value, best.value) ||
+       (other.value == best.value && other.index < best.index))) {
+    best = other;
+  }
+}
+
+// NaN never compares better, so it is skipped
+template <typename Better>
+void ScanRow(const double* row, int cols, long offset, Better better,
+             Extremum& best) {
+  Extremum lanes[4];
+  for (Extremum& lane : lanes) lane = {best.value, -1};
+  int j = 0;
+  for (; j + 4 <= cols; j += 4) {
+    for (int lane = 0; lane < 4; ++lane) {
+      double value = row[j + lane];
+      if (better(value, lanes[lane].value) ||
+          (lanes[lane].index < 0 && value == lanes[lane].value)) {
+        lanes[lane] = {value, offset + j + lane};
+      }
+    }
+  }
+  for (; j < cols; ++j) {
+    if (better(row[j], lanes[0].value) ||
+        (lanes[0].index < 0 && row[j] == lanes[0].value)) {
+      lanes[0] = {row[j], offset + j};
+    }
+  }
+  for (const Extremum& lane : lanes) MergeExtremum(best, lane, better);
+}
+
+// larger value wins, a NaN sticks once seen
+inline double MaxPropagateNan(double best, double value) {
+  return (value > best || value != value) && best == best ? value : best;
+}
+
+// folds |a[j] - b[j]| of one row into best in four lanes, combine decides
+// whether a NaN difference is kept or skipped
+template <typename Combine>
+double RowMaxAbsDiff(const double* a, const double* b, int cols, double best,
+                     Combine combine) {
+  double lanes[4] = {best, best, best, best};
+  int j = 0;
+  for (; j + 4 <= cols; j += 4) {
+    for (int lane = 0; lane < 4; ++lane) {
+      lanes[lane] = combine(lanes[lane], fabs(a[j + lane] - b[j + lane]));
+    }
+  }
+  for (; j < cols; ++j) lanes[0] = combine(lanes[0], fabs(a[j] - b[j]));
+  for (double lane : lanes) best = combine(best, lane);
+  return best;
+}
+
+// per-column compensated sums of absolute values
+struct ColumnSums {
+  std::vector<double> sums, errors;
+};
+
+// sum of squares relative to a running power of two scale, rows are folded
+// in one at a time like in LAPACK's dlassq so finite elements neither
+// overflow nor underflow, non-finite ones are kept aside
+struct ScaledSquares {
+  double scale = 0;
+  CompensatedSum squares;
+  double special = 0;
+
+  void Rescale(double new_scale) {
+    double factor = scale / new_scale;
+    factor *= factor;
+    for (int lane = 0; lane < 4; ++lane) {
+      squares.sums[lane] *= factor;
+      squares.errors[lane] *= factor;
+    }
+    scale = new_scale;
+  }
+
+  void Add(const double* values, int count) {
+    double largest = 0;
+    for (int j = 0; j < count; ++j) {
+      largest = MaxPropagateNan(largest, fabs(values[j]));
+    }
+    if (!std::isfinite(largest)) {
+      special = MaxPropagateNan(special, largest);
+      return;
+    }
+    if (largest == 0) return;
+    // the exponent is clamped so the inverse of a subnormal scale stays
+    // finite
+    double row_scale = std::ldexp(1.0, std::max(std::ilogb(largest), -1000));
+    if (row_scale > scale) Rescale(row_scale);
+    double inverse = 1 / scale;
+    squares.Add(values, count, [inverse](double value) {
+      double scaled = value * inverse;
+      return scaled * scaled;
+    });
+  }
+
+  void Merge(const ScaledSquares& other) {
+    special = MaxPropagateNan(special, other.special);
+    if (other.scale == 0) return;
+    ScaledSquares scaled = other;
+    if (scaled.scale < scale) {
+      scaled.Rescale(scale);
+    } else if (scaled.scale > scale) {
+      Rescale(scaled.scale);
+    }
+    squares.Merge(scaled.squares);
+  }
+
+  double Norm() const {
+    if (special != 0) return special;
+    return scale * sqrt(squares.Total());
+  }
+};
+
+}  // namespace
+
+Matrix::Matrix()
+    : rows_(1),
+      cols_(1),
+      matrix_(nullptr),
+      storage_(nullptr),
+      allocation_(default_allocation) {
+  Attach(Allocate(nullptr, rows_, cols_));
+}
+
+Matrix::Matrix(int rows, int cols)
+    : Matrix(rows, cols, default_allocation) {}
+
+Matrix::Matrix(int rows, int cols, Allocation allocation)
+    : rows_(rows),
+      cols_(cols),
+      matrix_(nullptr),
+      storage_(nullptr),
+      allocation_(allocation) {
+  if (rows <= 0 || cols <= 0) {
+    throw std::exception();
   }
+  Attach(Allocate(nullptr, rows_, cols_));
+}
+
+Matrix::Matrix(const Matrix& other)
+    : rows_(other.rows_),
+      cols_(other.cols_),
+      matrix_(other.matrix_),
+      storage_(other.storage_),
+      allocation_(other.allocation_) {
+  storage_->references.fetch_add(1, std::memory_order_relaxed);
 }
 
 Matrix::Matrix(Matrix&& other) noexcept
-    : rows_(other.rows_), cols_(other.cols_), matrix_(other.matrix_) {
+    : rows_(other.rows_),
+      cols_(other.cols_),
+      matrix_(other.matrix_),
+      storage_(other.storage_),
+      allocation_(other.allocation_) {
   other.matrix_ = nullptr;
+  other.storage_ = nullptr;
 }
 
 Matrix& Matrix::operator=(const Matrix& other) {
   if (this != &other) {
+    other.storage_->references.fetch_add(1, std::memory_order_relaxed);
     Delete();
     rows_ = other.rows_;
     cols_ = other.cols_;
-    matrix_ = new double*[rows_];
-    for (int i = 0; i < rows_; ++i) {
-      matrix_[i] = new double[cols_];
-    }
-    for (int i = 0; i < rows_; ++i) {
-      for (int j = 0; j < cols_; ++j) {
-        matrix_[i][j] = other.matrix_[i][j];
-      }
-    }
+    allocation_ = other.allocation_;
+    matrix_ = other.matrix_;
+    storage_ = other.storage_;
   }
   return *this;
 }
@@ -57,38 +406,177 @@ Matrix& Matrix::operator=(Matrix&& other) noexcept {
     Delete();
     rows_ = other.rows_;
     cols_ = other.cols_;
+    allocation_ = other.allocation_;
     matrix_ = other.matrix_;
+    storage_ = other.storage_;
     other.matrix_ = nullptr;
+    other.storage_ = nullptr;
   }
   return *this;
 }
 
 Matrix::~Matrix() {
-  if (matrix_) {
+  if (storage_) {
     Delete();
   }
 }
 
 bool Matrix::EqMatrix(const Matrix& other) const {
-  bool result = true;
   if (rows_ != other.rows_ || cols_ != other.cols_) {
-    result = false;
-  } else {
-    for (int i = 0; i < rows_; ++i) {
-      for (int j = 0; j < cols_; ++j) {
-        if (fabs(matrix_[i][j] - other.matrix_[i][j]) >= 1e-07) {
-          result = false;
+    return false;
+  }
+  if (matrix_ == other.matrix_) return true;
+  // shares the row kernel of MaxAbsDiff but skips NaN like the original
+  // element test did, ParallelReduce cannot stop early so the rows are
+  // scanned with ParallelFor until the first one that differs
+  std::atomic<bool> different(false);
+  ParallelFor(0, rows_, static_cast<long>(rows_) * cols_, [&](int i) {
+    if (different.load(std::memory_order_relaxed)) return;
+    double largest =
+        RowMaxAbsDiff(matrix_[i], other.matrix_[i], cols_, 0.0,
+                      [](double best, double value) {
+                        return std::max(best, value);
+                      });
+    if (largest >= 1e-07) different.store(true, std::memory_order_relaxed);
+  });
+  return !different.load();
+}
+
+double Matrix::Sum() const {
+  return ParallelReduce(
+             rows_, static_cast<long>(rows_) * cols_, CompensatedSum(),
+             [this](int i, CompensatedSum& sum) {
+               sum.Add(matrix_[i], cols_, [](double value) { return value; });
+             },
+             [](CompensatedSum& sum, const CompensatedSum& other) {
+               sum.Merge(other);
+             })
+      .Total();
+}
+
+double Matrix::Min() const {
+  int row_index, col_index;
+  return Min(row_index, col_index);
+}
+
+double Matrix::Min(int& row_index, int& col_index) const {
+  auto less = [](double left, double right) { return left < right; };
+  Extremum best = ParallelReduce(
+      rows_, static_cast<long>(rows_) * cols_, Extremum{INFINITY, -1},
+      [this, less](int i, Extremum& partial) {
+        ScanRow(matrix_[i], cols_, static_cast<long>(i) * cols_, less,
+                partial);
+      },
+      [less](Extremum& partial, const Extremum& other) {
+        MergeExtremum(partial, other, less);
+      });
+  if (best.index < 0) best = {matrix_[0][0], 0};
+  row_index = static_cast<int>(best.index / cols_);
+  col_index = static_cast<int>(best.index % cols_);
+  return best.value;
+}
+
+double Matrix::Max() const {
+  int row_index, col_index;
+  return Max(row_index, col_index);
+}
+
+double Matrix::Max(int& row_index, int& col_index) const {
+  auto greater = [](double left, double right) { return left > right; };
+  Extremum best = ParallelReduce(
+      rows_, static_cast<long>(rows_) * cols_, Extremum{-INFINITY, -1},
+      [this, greater](int i, Extremum& partial) {
+        ScanRow(matrix_[i], cols_, static_cast<long>(i) * cols_, greater,
+                partial);
+      },
+      [greater](Extremum& partial, const Extremum& other) {
+        MergeExtremum(partial, other, greater);
+      });
+  if (best.index < 0) best = {matrix_[0][0], 0};
+  row_index = static_cast<int>(best.index / cols_);
+  col_index = static_cast<int>(best.index % cols_);
+  return best.value;
+}
+
+double Matrix::Trace() const {
+  if (rows_ != cols_) {
+    throw std::exception();
+  }
+  double sum = 0, error = 0;
+  for (int i = 0; i < rows_; ++i) TwoSum(sum, error, matrix_[i][i]);
+  return std::isfinite(sum) ? sum + error : sum;
+}
+
+double Matrix::NormFrobenius() const {
+  return ParallelReduce(
+             rows_, static_cast<long>(rows_) * cols_, ScaledSquares(),
+             [this](int i, ScaledSquares& partial) {
+               partial.Add(matrix_[i], cols_);
+             },
+             [](ScaledSquares& partial, const ScaledSquares& other) {
+               partial.Merge(other);
+             })
+      .Norm();
+}
+
+double Matrix::NormOne() const {
+  ColumnSums columns = ParallelReduce(
+      rows_, static_cast<long>(rows_) * cols_,
+      ColumnSums{std::vector<double>(cols_), std::vector<double>(cols_)},
+      [this](int i, ColumnSums& partial) {
+        const double* row = matrix_[i];
+        for (int j = 0; j < cols_; ++j) {
+          TwoSum(partial.sums[j], partial.errors[j], fabs(row[j]));
         }
-      }
-    }
+      },
+      [this](ColumnSums& partial, const ColumnSums& other) {
+        for (int j = 0; j < cols_; ++j) {
+          TwoSum(partial.sums[j], partial.errors[j], other.sums[j]);
+          partial.errors[j] += other.errors[j];
+        }
+      });
+  double result = 0;
+  for (int j = 0; j < cols_; ++j) {
+    double sum = columns.sums[j];
+    if (std::isfinite(sum)) sum += columns.errors[j];
+    result = MaxPropagateNan(result, sum);
   }
   return result;
 }
 
+double Matrix::NormInf() const {
+  return ParallelReduce(
+      rows_, static_cast<long>(rows_) * cols_, 0.0,
+      [this](int i, double& partial) {
+        CompensatedSum sum;
+        sum.Add(matrix_[i], cols_, [](double value) { return fabs(value); });
+        partial = MaxPropagateNan(partial, sum.Total());
+      },
+      [](double& partial, double other) {
+        partial = MaxPropagateNan(partial, other);
+      });
+}
+
+double Matrix::MaxAbsDiff(const Matrix& other) const {
+  if (rows_ != other.rows_ || cols_ != other.cols_) {
+    throw std::exception();
+  }
+  return ParallelReduce(
+      rows_, static_cast<long>(rows_) * cols_, 0.0,
+      [this, &other](int i, double& partial) {
+        partial = RowMaxAbsDiff(matrix_[i], other.matrix_[i], cols_, partial,
+                                MaxPropagateNan);
+      },
+      [](double& partial, double other_partial) {
+        partial = MaxPropagateNan(partial, other_partial);
+      });
+}
+
 void Matrix::SumMatrix(const Matrix& other) {
   if (rows_ != other.rows_ || cols_ != other.cols_) {
     throw std::exception();
   }
+  Detach();
   for (int i = 0; i < rows_; ++i) {
     for (int j = 0; j < cols_; ++j) {
       matrix_[i][j] += other.matrix_[i][j];
@@ -100,6 +588,7 @@ void Matrix::SubMatrix(const Matrix& other) {
   if (rows_ != other.rows_ || cols_ != other.cols_) {
     throw std::exception();
   }
+  Detach();
   for (int i = 0; i < rows_; ++i) {
     for (int j = 0; j < cols_; ++j) {
       matrix_[i][j] -= other.matrix_[i][j];
@@ -108,6 +597,7 @@ void Matrix::SubMatrix(const Matrix& other) {
 }
 
 void Matrix::MulNumber(const double number) {
+  Detach();
   for (int i = 0; i < rows_; ++i) {
     for (int j = 0; j < cols_; ++j) {
       matrix_[i][j] *= number;
@@ -119,7 +609,7 @@ void Matrix::MulMatrix(const Matrix& other) {
   if (cols_ != other.rows_) {
     throw std::exception();
   }
-  Matrix matrix_tmp(rows_, other.cols_);
+  Matrix matrix_tmp(rows_, other.cols_, allocation_);
   for (int i = 0; i < rows_; ++i) {
     for (int j = 0; j < other.cols_; ++j) {
       double result = 0;
@@ -132,6 +622,201 @@ void Matrix::MulMatrix(const Matrix& other) {
   *this = std::move(matrix_tmp);
 }
 
+Matrix Matrix::Solve(const Matrix& rhs) const {
+  if (rows_ != cols_ || rhs.rows_ != rows_) {
+    throw std::exception();
+  }
+  std::vector<double> lu;
+  std::vector<int> pivots;
+  Factorize(lu, pivots);
+  return SolveFactorized(lu, pivots, rhs);
+}
+
+void Matrix::Factorize(std::vector<double>& lu,
+                       std::vector<int>& pivots) const {
+  if (rows_ != cols_) {
+    throw std::exception();
+  }
+  int n = rows_;
+  lu.resize(static_cast<size_t>(n) * n);
+  for (int i = 0; i < n; ++i) {
+    std::copy(matrix_[i], matrix_[i] + n, lu.begin() + i * n);
+  }
+  if (!FactorLu(lu, pivots, n)) {
+    throw std::exception();
+  }
+}
+
+Matrix Matrix::SolveFactorized(const std::vector<double>& lu,
+                               const std::vector<int>& pivots,
+                               const Matrix& rhs) {
+  int n = static_cast<int>(pivots.size());
+  if (rhs.rows_ != n) {
+    throw std::exception();
+  }
+  Matrix result(n, rhs.cols_);
+  SolveColumns(lu, pivots, n, rhs.matrix_, result.matrix_, rhs.cols_);
+  return result;
+}
+
+Matrix Matrix::SolveMixed(const Matrix& rhs, int& iterations) const {
+  if (rows_ != cols_ || rhs.rows_ != rows_) {
+    throw std::exception();
+  }
+  const int kMaxIterations = 30;
+  int n = rows_, m = rhs.cols_;
+  std::vector<float> lu(static_cast<size_t>(n) * n);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      lu[i * n + j] = static_cast<float>(matrix_[i][j]);
+    }
+  }
+  std::vector<int> pivots;
+  if (FactorLu(lu, pivots, n)) {
+    // refine the single precision solution with residuals computed in
+    // double until the backward error reaches double precision
+    Matrix result(n, m);
+    Matrix product(n, m);
+    Matrix residual(n, m);
+    Matrix correction(n, m);
+    SolveColumns(lu, pivots, n, rhs.matrix_, result.matrix_, m);
+    double tolerance = sqrt(static_cast<double>(n)) *
+                       MaxAbs(matrix_, n, n) * 2.220446049250313e-16;
+    for (iterations = 0; iterations <= kMaxIterations; ++iterations) {
+      MultiplyRows(matrix_, result.matrix_, product.matrix_, n, n, m);
+      for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < m; ++j) {
+          residual.matrix_[i][j] = rhs.matrix_[i][j] - product.matrix_[i][j];
+        }
+      }
+      double error = MaxAbs(residual.matrix_, n, m);
+      double size = MaxAbs(result.matrix_, n, m);
+      if (!std::isfinite(error) || !std::isfinite(size)) break;
+      if (error <= size * tolerance) return result;
+      if (iterations == kMaxIterations) break;
+      SolveColumns(lu, pivots, n, residual.matrix_, correction.matrix_, m);
+      result.SumMatrix(correction);
+    }
+  }
+  iterations = -1;
+  return Solve(rhs);
+}
+
+Matrix Matrix::InverseMixed(int& iterations) const {
+  if (rows_ != cols_) {
+    throw std::exception();
+  }
+  Matrix identity(rows_, cols_);
+  for (int i = 0; i < rows_; ++i) identity.matrix_[i][i] = 1;
+  return SolveMixed(identity, iterations);
+}
+
+Matrix Matrix::MultiplyChain(
+    const std::vector<std::reference_wrapper<const Matrix>>& chain) {
+  if (chain.empty()) {
+    throw std::exception();
+  }
+  Matrix result(chain.front().get().rows_, chain.back().get().cols_);
+  MultiplyChain(chain, result);
+  return result;
+}
+
+void Matrix::MultiplyChain(
+    const std::vector<std::reference_wrapper<const Matrix>>& chain,
+    Matrix& result) {
+  int n = static_cast<int>(chain.size());
+  for (int i = 0; i + 1 < n; ++i) {
+    if (chain[i].get().cols_ != chain[i + 1].get().rows_) {
+      throw std::exception();
+    }
+  }
+  if (result.rows_ != chain[0].get().rows_ ||
+      result.cols_ != chain[n - 1].get().cols_) {
+    throw std::exception();
+  }
+  result.Detach();
+  if (n == 1) {
+    for (int i = 0; i < result.rows_; ++i) {
+      std::copy(chain[0].get().matrix_[i],
+                chain[0].get().matrix_[i] + result.cols_, result.matrix_[i]);
+    }
+    return;
+  }
+
+  // cost[i][j] is the fewest scalar multiplications for chain[i..j] and
+  // split[i][j] the last product of that grouping
+  std::vector<double> dims(n + 1);
+  dims[0] = chain[0].get().rows_;
+  for (int i = 0; i < n; ++i) dims[i + 1] = chain[i].get().cols_;
+  std::vector<std::vector<double>> cost(n, std::vector<double>(n, 0));
+  std::vector<std::vector<int>> split(n, std::vector<int>(n, 0));
+  for (int length = 2; length <= n; ++length) {
+    for (int i = 0; i + length - 1 < n; ++i) {
+      int j = i + length - 1;
+      cost[i][j] = -1;
+      for (int k = i; k < j; ++k) {
+        double c = cost[i][k] + cost[k + 1][j] +
+                   dims[i] * dims[k + 1] * dims[j + 1];
+        if (cost[i][j] < 0 || c < cost[i][j]) {
+          cost[i][j] = c;
+          split[i][j] = k;
+        }
+      }
+    }
+  }
+
+  // intermediate products live in flat scratch buffers that return to a
+  // free list as soon as they are consumed
+  std::vector<std::vector<double>> free_buffers;
+  auto acquire = [&free_buffers](size_t size) {
+    auto best = free_buffers.end();
+    for (auto it = free_buffers.begin(); it != free_buffers.end(); ++it) {
+      if (it->capacity() >= size &&
+          (best == free_buffers.end() || it->capacity() < best->capacity())) {
+        best = it;
+      }
+    }
+    std::vector<double> buffer;
+    if (best != free_buffers.end()) {
+      buffer = std::move(*best);
+      free_buffers.erase(best);
+    }
+    buffer.resize(size);
+    return buffer;
+  };
+  std::function<void(int, int, double* const*)> multiply =
+      [&](int i, int j, double* const* out) {
+        int k = split[i][j];
+        int rows = static_cast<int>(dims[i]);
+        int inner = static_cast<int>(dims[k + 1]);
+        int cols = static_cast<int>(dims[j + 1]);
+        const double* const* left = chain[i].get().matrix_;
+        const double* const* right = chain[k + 1].get().matrix_;
+        std::vector<double> left_buffer, right_buffer;
+        std::vector<double*> left_rows, right_rows;
+        if (k > i) {
+          left_buffer = acquire(static_cast<size_t>(rows) * inner);
+          for (int r = 0; r < rows; ++r) {
+            left_rows.push_back(left_buffer.data() + r * inner);
+          }
+          multiply(i, k, left_rows.data());
+          left = left_rows.data();
+        }
+        if (j > k + 1) {
+          right_buffer = acquire(static_cast<size_t>(inner) * cols);
+          for (int r = 0; r < inner; ++r) {
+            right_rows.push_back(right_buffer.data() + r * cols);
+          }
+          multiply(k + 1, j, right_rows.data());
+          right = right_rows.data();
+        }
+        MultiplyRows(left, right, out, rows, inner, cols);
+        if (k > i) free_buffers.push_back(std::move(left_buffer));
+        if (j > k + 1) free_buffers.push_back(std::move(right_buffer));
+      };
+  multiply(0, n - 1, result.matrix_);
+}
+
 Matrix Matrix::Transpose() const {
   Matrix result(cols_, rows_);
   for (int i = 0; i < rows_; ++i) {
@@ -234,6 +919,350 @@ Matrix Matrix::InverseMatrix() const {
   return result;
 }
 
+void Matrix::EigenSymmetric(Matrix& values, Matrix& vectors) const {
+  if (rows_ != cols_) {
+    throw std::exception();
+  }
+  for (int i = 0; i < rows_; ++i) {
+    for (int j = i + 1; j < cols_; ++j) {
+      if (fabs(matrix_[i][j] - matrix_[j][i]) >= 1e-07) {
+        throw std::exception();
+      }
+    }
+  }
+  int n = rows_;
+  Matrix v = Clone();
+  double** a = v.matrix_;
+  std::vector<double> d(n), e(n);
+
+  // Householder reduction to tridiagonal form
+  for (int j = 0; j < n; ++j) d[j] = a[n - 1][j];
+  for (int i = n - 1; i > 0; --i) {
+    double scale = 0, h = 0;
+    for (int k = 0; k < i; ++k) scale += fabs(d[k]);
+    if (scale == 0) {
+      e[i] = d[i - 1];
+      for (int j = 0; j < i; ++j) {
+        d[j] = a[i - 1][j];
+        a[i][j] = 0;
+        a[j][i] = 0;
+      }
+    } else {
+      for (int k = 0; k < i; ++k) {
+        d[k] /= scale;
+        h += d[k] * d[k];
+      }
+      double f = d[i - 1];
+      double g = (f > 0) ? -sqrt(h) : sqrt(h);
+      e[i] = scale * g;
+      h -= f * g;
+      d[i - 1] = f - g;
+      for (int j = 0; j < i; ++j) e[j] = 0;
+      for (int j = 0; j < i; ++j) {
+        f = d[j];
+        a[j][i] = f;
+        g = e[j] + a[j][j] * f;
+        for (int k = j + 1; k < i; ++k) {
+          g += a[k][j] * d[k];
+          e[k] += a[k][j] * f;
+        }
+        e[j] = g;
+      }
+      f = 0;
+      for (int j = 0; j < i; ++j) {
+        e[j] /= h;
+        f += e[j] * d[j];
+      }
+      double hh = f / (h + h);
+      for (int j = 0; j < i; ++j) e[j] -= hh * d[j];
+      ParallelFor(0, i, static_cast<long>(i) * i, [&](int j) {
+        for (int k = j; k < i; ++k) a[k][j] -= (d[j] * e[k] + e[j] * d[k]);
+      });
+      for (int j = 0; j < i; ++j) {
+        d[j] = a[i - 1][j];
+        a[i][j] = 0;
+      }
+    }
+    d[i] = h;
+  }
+
+  // accumulation of the transformations
+  for (int i = 0; i < n - 1; ++i) {
+    a[n - 1][i] = a[i][i];
+    a[i][i] = 1;
+    double h = d[i + 1];
+    if (h != 0) {
+      for (int k = 0; k <= i; ++k) d[k] = a[k][i + 1] / h;
+      ParallelFor(0, i + 1, static_cast<long>(i) * i, [&](int j) {
+        double g = 0;
+        for (int k = 0; k <= i; ++k) g += a[k][i + 1] * a[k][j];
+        for (int k = 0; k <= i; ++k) a[k][j] -= g * d[k];
+      });
+    }
+    for (int k = 0; k <= i; ++k) a[k][i + 1] = 0;
+  }
+  for (int j = 0; j < n; ++j) {
+    d[j] = a[n - 1][j];
+    a[n - 1][j] = 0;
+  }
+  a[n - 1][n - 1] = 1;
+  e[0] = 0;
+
+  // rows of z are the eigenvectors, so every rotation below combines two
+  // contiguous rows, like vt in Svd
+  Matrix vt = v.Transpose();
+  double** z = vt.matrix_;
+  const int kBlock = 256;
+  std::vector<double> cosines(n), sines(n);
+
+  // implicit QL iterations on the tridiagonal matrix, the negated
+  // comparisons keep NaN unconverged so that it runs into the cap
+  for (int i = 1; i < n; ++i) e[i - 1] = e[i];
+  e[n - 1] = 0;
+  double f = 0, tst1 = 0;
+  const double eps = pow(2.0, -52.0);
+  int iterations = 0;
+  for (int l = 0; l < n; ++l) {
+    tst1 = std::max(tst1, fabs(d[l]) + fabs(e[l]));
+    int m = l;
+    while (m < n - 1 && !(fabs(e[m]) <= eps * tst1)) ++m;
+    if (m > l) {
+      do {
+        if (++iterations > 30 * n) {
+          throw std::exception();
+        }
+        double g = d[l];
+        double p = (d[l + 1] - g) / (2 * e[l]);
+        double r = (p < 0) ? -hypot(p, 1.0) : hypot(p, 1.0);
+        d[l] = e[l] / (p + r);
+        d[l + 1] = e[l] * (p + r);
+        double dl1 = d[l + 1];
+        double h = g - d[l];
+        for (int i = l + 2; i < n; ++i) d[i] -= h;
+        f += h;
+        p = d[m];
+        double c = 1, c2 = 1, c3 = 1, s = 0, s2 = 0;
+        double el1 = e[l + 1];
+        for (int i = m - 1; i >= l; --i) {
+          c3 = c2;
+          c2 = c;
+          s2 = s;
+          g = c * e[i];
+          h = c * p;
+          r = hypot(p, e[i]);
+          e[i + 1] = s * r;
+          s = e[i] / r;
+          c = p / r;
+          p = c * d[i] - s * g;
+          d[i + 1] = h + s * (c * g + s * d[i]);
+          cosines[i] = c;
+          sines[i] = s;
+        }
+        // column blocks of z take the whole sequence of rotations
+        // concurrently
+        long work = static_cast<long>(n) * (m - l);
+        ParallelFor(0, (n + kBlock - 1) / kBlock, work, [&](int block) {
+          int begin = block * kBlock, end = std::min(n, begin + kBlock);
+          for (int i = m - 1; i >= l; --i) {
+            double* zi = z[i];
+            double* zn = z[i + 1];
+            for (int k = begin; k < end; ++k) {
+              double t = zn[k];
+              zn[k] = sines[i] * zi[k] + cosines[i] * t;
+              zi[k] = cosines[i] * zi[k] - sines[i] * t;
+            }
+          }
+        });
+        p = -s * s2 * c3 * el1 * e[l] / dl1;
+        e[l] = s * p;
+        d[l] = c * p;
+      } while (!(fabs(e[l]) <= eps * tst1));
+    }
+    d[l] += f;
+    if (std::isnan(d[l])) {
+      throw std::exception();
+    }
+    e[l] = 0;
+  }
+
+  // ascending order of eigenvalues
+  std::vector<int> order(n);
+  for (int i = 0; i < n; ++i) order[i] = i;
+  std::sort(order.begin(), order.end(),
+            [&d](int x, int y) { return d[x] < d[y]; });
+  Matrix result_values(n, 1);
+  Matrix result_vectors(n, n);
+  for (int j = 0; j < n; ++j) {
+    result_values.matrix_[j][0] = d[order[j]];
+    for (int i = 0; i < n; ++i) {
+      result_vectors.matrix_[i][j] = z[order[j]][i];
+    }
+  }
+  values = std::move(result_values);
+  vectors = std::move(result_vectors);
+}
+
+void Matrix::Svd(Matrix& u, Matrix& s, Matrix& v) const {
+  if (rows_ < cols_) {
+    Transpose().Svd(v, s, u);
+    return;
+  }
+  int m = rows_, n = cols_;
+  // rows of w are the columns of the current matrix, rows of vt are the
+  // right singular vectors, so every rotation touches contiguous memory
+  Matrix w = Transpose();
+  Matrix vt(n, n);
+  for (int i = 0; i < n; ++i) vt.matrix_[i][i] = 1;
+
+  // one-sided Jacobi with round-robin pairing: every round consists of
+  // disjoint column pairs that are rotated concurrently
+  int players = n + (n % 2);
+  std::vector<int> ring(players);
+  for (int i = 0; i < players; ++i) ring[i] = i;
+  const double eps = 1e-15;
+  bool converged = false;
+  for (int sweep = 0; sweep < 60 && !converged; ++sweep) {
+    std::atomic<bool> rotated(false);
+    for (int round = 0; round < players - 1; ++round) {
+      ParallelFor(0, players / 2, static_cast<long>(m) * players, [&](int k) {
+        int p = ring[k], q = ring[players - 1 - k];
+        if (p >= n || q >= n) return;
+        double* wp = w.matrix_[p];
+        double* wq = w.matrix_[q];
+        double alpha = 0, beta = 0, gamma = 0;
+        for (int i = 0; i < m; ++i) {
+          alpha += wp[i] * wp[i];
+          beta += wq[i] * wq[i];
+          gamma += wp[i] * wq[i];
+        }
+        if (fabs(gamma) <= eps * sqrt(alpha * beta)) return;
+        rotated = true;
+        double zeta = (beta - alpha) / (2 * gamma);
+        double t = ((zeta < 0) ? -1.0 : 1.0) /
+                   (fabs(zeta) + sqrt(1 + zeta * zeta));
+        double c = 1 / sqrt(1 + t * t);
+        double sn = c * t;
+        for (int i = 0; i < m; ++i) {
+          double tmp = wp[i];
+          wp[i] = c * tmp - sn * wq[i];
+          wq[i] = sn * tmp + c * wq[i];
+        }
+        double* vp = vt.matrix_[p];
+        double* vq = vt.matrix_[q];
+        for (int i = 0; i < n; ++i) {
+          double tmp = vp[i];
+          vp[i] = c * tmp - sn * vq[i];
+          vq[i] = sn * tmp + c * vq[i];
+        }
+      });
+      std::rotate(ring.begin() + 1, ring.end() - 1, ring.end());
+    }
+    converged = !rotated;
+  }
+  if (!converged) {
+    throw std::exception();
+  }
+
+  std::vector<double> sigma(n);
+  std::vector<int> order(n);
+  for (int j = 0; j < n; ++j) {
+    double norm = 0;
+    for (int i = 0; i < m; ++i) norm += w.matrix_[j][i] * w.matrix_[j][i];
+    sigma[j] = sqrt(norm);
+    order[j] = j;
+  }
+  std::sort(order.begin(), order.end(),
+            [&sigma](int x, int y) { return sigma[x] > sigma[y]; });
+  // columns of U for singular values at rounding level are mostly noise,
+  // they are rebuilt below so that U keeps orthonormal columns
+  double threshold = sigma[order[0]] * m * 2.220446049250313e-16;
+  Matrix result_u(m, n);
+  Matrix result_s(n, 1);
+  Matrix result_v(n, n);
+  std::vector<int> deficient;
+  for (int j = 0; j < n; ++j) {
+    int col = order[j];
+    result_s.matrix_[j][0] = sigma[col];
+    if (sigma[col] > threshold) {
+      for (int i = 0; i < m; ++i) {
+        result_u.matrix_[i][j] = w.matrix_[col][i] / sigma[col];
+      }
+    } else {
+      deficient.push_back(j);
+    }
+    for (int i = 0; i < n; ++i) result_v.matrix_[i][j] = vt.matrix_[col][i];
+  }
+  // completion by Gram-Schmidt: the unit vector with the largest component
+  // outside the accepted columns is orthogonalized against them twice, as
+  // m >= n such a vector always keeps a norm of at least 1 / sqrt(m)
+  std::vector<int> accepted;
+  for (int j = 0; j < n; ++j) {
+    if (sigma[order[j]] > threshold) accepted.push_back(j);
+  }
+  std::vector<double> candidate(m);
+  for (int j : deficient) {
+    int unit = 0;
+    double best = -1;
+    for (int i = 0; i < m; ++i) {
+      double outside = 1;
+      for (int k : accepted) {
+        outside -= result_u.matrix_[i][k] * result_u.matrix_[i][k];
+      }
+      if (outside > best) {
+        best = outside;
+        unit = i;
+      }
+    }
+    std::fill(candidate.begin(), candidate.end(), 0.0);
+    candidate[unit] = 1;
+    for (int pass = 0; pass < 2; ++pass) {
+      for (int k : accepted) {
+        double dot = 0;
+        for (int i = 0; i < m; ++i) {
+          dot += result_u.matrix_[i][k] * candidate[i];
+        }
+        for (int i = 0; i < m; ++i) {
+          candidate[i] -= dot * result_u.matrix_[i][k];
+        }
+      }
+    }
+    double norm = 0;
+    for (double value : candidate) norm += value * value;
+    norm = sqrt(norm);
+    for (int i = 0; i < m; ++i) result_u.matrix_[i][j] = candidate[i] / norm;
+    accepted.push_back(j);
+  }
+  u = std::move(result_u);
+  s = std::move(result_s);
+  v = std::move(result_v);
+}
+
+std::shared_future<Matrix> Matrix::MulMatrixAsync(const Matrix& other) const {
+  return std::async(std::launch::async,
+                    [left = *this, right = other] { return left * right; })
+      .share();
+}
+
+std::shared_future<Matrix> Matrix::InverseAsync() const {
+  return std::async(std::launch::async,
+                    [operand = *this] { return operand.InverseMatrix(); })
+      .share();
+}
+
+std::shared_future<Matrix> Matrix::MulMatrixAsync(
+    std::shared_future<Matrix> left, std::shared_future<Matrix> right) {
+  return std::async(std::launch::async,
+                    [left, right] { return left.get() * right.get(); })
+      .share();
+}
+
+std::shared_future<Matrix> Matrix::InverseAsync(
+    std::shared_future<Matrix> operand) {
+  return std::async(std::launch::async,
+                    [operand] { return operand.get().InverseMatrix(); })
+      .share();
+}
+
 Matrix Matrix::operator+(const Matrix& other) const {
   Matrix result(*this);
   result.SumMatrix(other);
@@ -283,7 +1312,7 @@ Matrix& Matrix::operator*=(const Matrix& other) {
   return *this;
 }
 
-Matrix& Matrix::operator*=(const double number) noexcept {
+Matrix& Matrix::operator*=(const double number) {
   this->MulNumber(number);
   return *this;
 }
@@ -301,37 +1330,129 @@ double& Matrix::operator()(int row_index, int col_index) {
       col_index >= cols_) {
     throw std::exception();
   }
+  Detach();
   return matrix_[row_index][col_index];
 }
 
+Matrix::iterator Matrix::begin() {
+  Detach();
+  return iterator(matrix_, cols_, 0, 0);
+}
+
+Matrix::iterator Matrix::end() {
+  Detach();
+  return iterator(matrix_, cols_, rows_, 0);
+}
+
+Matrix::const_iterator Matrix::begin() const {
+  return const_iterator(matrix_, cols_, 0, 0);
+}
+
+Matrix::const_iterator Matrix::end() const {
+  return const_iterator(matrix_, cols_, rows_, 0);
+}
+
+Matrix::const_iterator Matrix::cbegin() const { return begin(); }
+
+Matrix::const_iterator Matrix::cend() const { return end(); }
+
+Matrix::RowRange<double> Matrix::Rows() {
+  Detach();
+  return {row_iterator(matrix_, cols_, 0), row_iterator(matrix_, cols_, rows_)};
+}
+
+Matrix::RowRange<const double> Matrix::Rows() const {
+  return {const_row_iterator(matrix_, cols_, 0),
+          const_row_iterator(matrix_, cols_, rows_)};
+}
+
 int Matrix::GetRows() const { return rows_; }
 
 int Matrix::GetCols() const { return cols_; }
 
+// shrinking only hides elements, so it is done in place even when the
+// storage is shared, growing reallocates geometrically past the capacity
 void Matrix::SetRows(int rows_number) {
   if (rows_number < 1) {
     throw std::exception();
   }
-  Matrix result(rows_number, cols_);
-  for (int i = 0; i < rows_number; ++i) {
-    for (int j = 0; j < cols_; ++j) {
-      if (rows_ > i && cols_ > j) result.matrix_[i][j] = matrix_[i][j];
+  if (rows_number > rows_) {
+    if (rows_number > storage_->row_capacity) {
+      Reallocate(std::max(rows_number, 2 * storage_->row_capacity),
+                 storage_->col_capacity);
+    } else {
+      Detach();
+    }
+    for (int i = rows_; i < rows_number; ++i) {
+      std::fill(matrix_[i], matrix_[i] + cols_, 0.0);
     }
   }
-  *this = std::move(result);
+  rows_ = rows_number;
 }
 
 void Matrix::SetCols(int cols_number) {
   if (cols_number < 1) {
     throw std::exception();
   }
-  Matrix result(rows_, cols_number);
-  for (int i = 0; i < rows_; ++i) {
-    for (int j = 0; j < cols_number; ++j) {
-      if (rows_ > i && cols_ > j) result.matrix_[i][j] = matrix_[i][j];
+  if (cols_number > cols_) {
+    if (cols_number > storage_->col_capacity) {
+      Reallocate(storage_->row_capacity,
+                 std::max(cols_number, 2 * storage_->col_capacity));
+    } else {
+      Detach();
+    }
+    for (int i = 0; i < rows_; ++i) {
+      std::fill(matrix_[i] + cols_, matrix_[i] + cols_number, 0.0);
     }
   }
-  *this = std::move(result);
+  cols_ = cols_number;
+}
+
+int Matrix::GetRowCapacity() const { return storage_->row_capacity; }
+
+int Matrix::GetColCapacity() const { return storage_->col_capacity; }
+
+void Matrix::Reserve(int rows_number, int cols_number) {
+  if (rows_number < 1 || cols_number < 1) {
+    throw std::exception();
+  }
+  if (rows_number > storage_->row_capacity ||
+      cols_number > storage_->col_capacity) {
+    Reallocate(std::max(rows_number, storage_->row_capacity),
+               std::max(cols_number, storage_->col_capacity));
+  }
+}
+
+void Matrix::ShrinkToFit() {
+  if (rows_ < storage_->row_capacity || cols_ < storage_->col_capacity) {
+    Reallocate(rows_, cols_);
+  }
+}
+
+void Matrix::AppendRow(const Matrix& row) {
+  if (row.rows_ != 1) {
+    throw std::exception();
+  }
+  AppendRows(row);
+}
+
+void Matrix::AppendRows(const Matrix& rows) {
+  if (rows.cols_ != cols_) {
+    throw std::exception();
+  }
+  // rows may be this matrix, its elements stay valid through Reallocate
+  int count = rows.rows_;
+  int first = rows_;
+  if (first + count > storage_->row_capacity) {
+    Reallocate(std::max(first + count, 2 * storage_->row_capacity),
+               storage_->col_capacity);
+  } else {
+    Detach();
+  }
+  for (int i = 0; i < count; ++i) {
+    std::copy(rows.matrix_[i], rows.matrix_[i] + cols_, matrix_[first + i]);
+  }
+  rows_ = first + count;
 }
 
 std::ostream& operator<<(std::ostream& out, const Matrix& p) {
@@ -344,9 +1465,156 @@ std::ostream& operator<<(std::ostream& out, const Matrix& p) {
   return out;
 }
 
+// in-place LU without pivoting of a square block, used by the tiled and
+// distributed factorizations
+void Matrix::FactorTile(Matrix& tile) {
+  tile.Detach();
+  int n = tile.rows_;
+  double** a = tile.matrix_;
+  for (int k = 0; k < n; ++k) {
+    if (a[k][k] == 0) {
+      throw std::exception();
+    }
+    for (int i = k + 1; i < n; ++i) {
+      a[i][k] /= a[k][k];
+      for (int j = k + 1; j < n; ++j) a[i][j] -= a[i][k] * a[k][j];
+    }
+  }
+}
+
+void Matrix::SolveLowerUnit(const Matrix& factor, Matrix& tile) {
+  tile.Detach();
+  // tile = L^-1 * tile
+  for (int i = 0; i < tile.rows_; ++i) {
+    double* row = tile.matrix_[i];
+    for (int r = 0; r < i; ++r) {
+      double l = factor.matrix_[i][r];
+      const double* source = tile.matrix_[r];
+      for (int j = 0; j < tile.cols_; ++j) row[j] -= l * source[j];
+    }
+  }
+}
+
+void Matrix::SolveUpper(const Matrix& factor, Matrix& tile) {
+  tile.Detach();
+  // tile = tile * U^-1
+  for (int i = 0; i < tile.rows_; ++i) {
+    double* row = tile.matrix_[i];
+    for (int j = 0; j < tile.cols_; ++j) {
+      row[j] /= factor.matrix_[j][j];
+      const double* u = factor.matrix_[j];
+      for (int c = j + 1; c < tile.cols_; ++c) row[c] -= row[j] * u[c];
+    }
+  }
+}
+
+Matrix::Allocation Matrix::GetAllocation() const { return allocation_; }
+
+Matrix::Allocation Matrix::GetDefaultAllocation() {
+  return default_allocation;
+}
+
+void Matrix::SetDefaultAllocation(Allocation allocation) {
+  default_allocation = allocation;
+}
+
+Matrix Matrix::Clone() const {
+  Matrix result(*this);
+  result.Reallocate(rows_, cols_);
+  return result;
+}
+
+bool Matrix::IsShared() const {
+  return storage_->references.load(std::memory_order_acquire) > 1;
+}
+
 void Matrix::Delete() {
-  for (int i = 0; i < rows_; ++i) {
-    delete[] matrix_[i];
+  if (storage_ &&
+      storage_->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    if (storage_->mapped_bytes) {
+      munmap(storage_->data, storage_->mapped_bytes);
+    } else {
+      delete[] storage_->data;
+    }
+    delete[] storage_->rows;
+    delete storage_;
   }
-  delete[] matrix_;
-}
\ No newline at end of file
+  matrix_ = nullptr;
+  storage_ = nullptr;
+}
+
+void Matrix::Detach() {
+  if (IsShared()) {
+    Reallocate(storage_->row_capacity, storage_->col_capacity);
+  }
+}
+
+void Matrix::Reallocate(int row_capacity, int col_capacity) {
+  Storage* copy = Allocate(this, row_capacity, col_capacity);
+  Delete();
+  Attach(copy);
+}
+
+void Matrix::Attach(Storage* storage) {
+  storage_ = storage;
+  matrix_ = storage->rows;
+}
+
+// only the rows_ x cols_ elements are initialized, the spare capacity is
+// left untouched until the matrix grows into it
+Matrix::Storage* Matrix::Allocate(const Matrix* source, int row_capacity,
+                                  int col_capacity) const {
+  size_t count = static_cast<size_t>(row_capacity) * col_capacity;
+  size_t bytes = count * sizeof(double);
+  Storage* storage =
+      new Storage{{1}, nullptr, nullptr, 0, row_capacity, col_capacity};
+  // below one huge page a mapping would only waste memory, so both huge
+  // page policies use the heap there
+  if (allocation_ != Allocation::kHeap && bytes >= kHugePageBytes) {
+    size_t length = (bytes + kHugePageBytes - 1) / kHugePageBytes *
+                    kHugePageBytes;
+    void* memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // the reserved pool is scarce, only an explicit request draws on it
+    if (allocation_ == Allocation::kHugePages) {
+      memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (memory == MAP_FAILED) {
+      // no reserved huge pages, ask for transparent ones instead
+      memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+      if (memory != MAP_FAILED) madvise(memory, length, MADV_HUGEPAGE);
+#endif
+    }
+    if (memory != MAP_FAILED) {
+      storage->data = static_cast<double*>(memory);
+      storage->mapped_bytes = length;
+    }
+  }
+  if (!storage->data) {
+    storage->data = new double[count];
+  }
+  storage->rows = new double*[row_capacity];
+  for (int i = 0; i < row_capacity; ++i) {
+    storage->rows[i] = storage->data + static_cast<size_t>(i) * col_capacity;
+  }
+  // the first write places a page on the memory node of the writing thread,
+  // so rows of large matrices are initialized with the pinned row split
+  // ParallelFor gives the LU and reduction kernels, smaller ones are not
+  // worth the thread start-up
+  double** rows = storage->rows;
+  int cols = cols_;
+  long elements = static_cast<long>(rows_) * cols_;
+  long work = elements * sizeof(double) >= kHugePageBytes ? elements : 0;
+  ParallelFor(0, rows_, work, [=](int i) {
+    if (source) {
+      std::copy(source->matrix_[i], source->matrix_[i] + cols, rows[i]);
+    } else {
+      std::fill(rows[i], rows[i] + cols, 0.0);
+    }
+  });
+  return storage;
+}
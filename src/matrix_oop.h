@@ -1,14 +1,43 @@
 #ifndef SRC_MATRIX_OOP_H
 #define SRC_MATRIX_OOP_H
 
+#include <atomic>
+#include <cassert>
 #include <cmath>
+#include <compare>
+#include <cstddef>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <span>
+#include <type_traits>
+#include <vector>
 
 class Matrix {
  public:
+  // storage policy for matrices of at least one huge page (2 MB), smaller
+  // ones always use the heap; kHugePages takes reserved huge pages when
+  // available and transparent ones otherwise, kAuto only transparent ones
+  enum class Allocation { kAuto, kHeap, kHugePages };
+
+  // iterators, elements are visited in row-major order and rows are
+  // dereferenced as spans
+  template <typename T>
+  class ElementIterator;
+  template <typename T>
+  class RowIterator;
+  template <typename T>
+  class RowRange;
+  using iterator = ElementIterator<double>;
+  using const_iterator = ElementIterator<const double>;
+  using row_iterator = RowIterator<double>;
+  using const_row_iterator = RowIterator<const double>;
+
   // constructors
   Matrix();
   Matrix(int rows, int cols);
+  Matrix(int rows, int cols, Allocation allocation);
   Matrix(const Matrix& other);
   Matrix(Matrix&& other) noexcept;
   Matrix& operator=(const Matrix& other);
@@ -28,6 +57,43 @@ class Matrix {
   Matrix CreateMinor(const int i, const int j) const;
   double Determinant() const;
   Matrix InverseMatrix() const;
+  static Matrix MultiplyChain(
+      const std::vector<std::reference_wrapper<const Matrix>>& chain);
+
+  // reductions, sums (including the row and column sums of the norms) are
+  // compensated and split over several accumulators and threads, the
+  // Frobenius norm is accumulated with a running scale, Min and Max skip
+  // NaN and report the first position of the extremum, the norms and
+  // MaxAbsDiff return NaN if they meet one
+  double Sum() const;
+  double Min() const;
+  double Min(int& row_index, int& col_index) const;
+  double Max() const;
+  double Max(int& row_index, int& col_index) const;
+  double Trace() const;
+  double NormFrobenius() const;
+  double NormOne() const;
+  double NormInf() const;
+  double MaxAbsDiff(const Matrix& other) const;
+
+  // linear systems, the mixed precision variants factorize in float and
+  // refine in double, iterations receives the number of refinement steps
+  // or -1 when they did not converge and a double factorization was used
+  Matrix Solve(const Matrix& rhs) const;
+  Matrix SolveMixed(const Matrix& rhs, int& iterations) const;
+  Matrix InverseMixed(int& iterations) const;
+
+  // decompositions
+  void EigenSymmetric(Matrix& values, Matrix& vectors) const;
+  void Svd(Matrix& u, Matrix& s, Matrix& v) const;
+
+  // asynchronous operations
+  std::shared_future<Matrix> MulMatrixAsync(const Matrix& other) const;
+  std::shared_future<Matrix> InverseAsync() const;
+  static std::shared_future<Matrix> MulMatrixAsync(
+      std::shared_future<Matrix> left, std::shared_future<Matrix> right);
+  static std::shared_future<Matrix> InverseAsync(
+      std::shared_future<Matrix> operand);
 
   // overloads
   Matrix operator+(const Matrix& other) const;
@@ -39,24 +105,291 @@ class Matrix {
   Matrix& operator+=(const Matrix& other);
   Matrix& operator-=(const Matrix& other);
   Matrix& operator*=(const Matrix& other);
-  Matrix& operator*=(const double number) noexcept;
+  Matrix& operator*=(const double number);
   const double& operator()(int row_index, int col_index) const;
   double& operator()(int row_index, int col_index);
 
+  // row access without bounds checks, the row index is verified with assert
+  // when NDEBUG is not defined and the column index only by the span itself
+  // under _GLIBCXX_ASSERTIONS; the non-const overload unshares the elements
+  // on every call, so hot loops should take the row once (auto row =
+  // matrix[i]) or iterate Rows(), which unshares a single time
+  std::span<double> operator[](int row_index);
+  std::span<const double> operator[](int row_index) const;
+
+  // iteration over elements and rows, the non-const overloads unshare the
+  // elements first and are invalidated like references from operator()
+  iterator begin();
+  iterator end();
+  const_iterator begin() const;
+  const_iterator end() const;
+  const_iterator cbegin() const;
+  const_iterator cend() const;
+  RowRange<double> Rows();
+  RowRange<const double> Rows() const;
+
   // mutators & accessors
   int GetRows() const;
   int GetCols() const;
   void SetRows(int rows_number);
   void SetCols(int cols_number);
+  int GetRowCapacity() const;
+  int GetColCapacity() const;
+  Allocation GetAllocation() const;
+  static Allocation GetDefaultAllocation();
+  static void SetDefaultAllocation(Allocation allocation);
+
+  // capacity, like std::vector growing rows or columns within the
+  // capacity does not reallocate and shrinking never does
+  void Reserve(int rows_number, int cols_number);
+  void ShrinkToFit();
+  void AppendRow(const Matrix& row);
+  void AppendRows(const Matrix& rows);
+
+  // copies share their elements until one of them is modified, references
+  // returned by the non-const operator() are invalidated by copying
+  Matrix Clone() const;
+  bool IsShared() const;
 
   // other functions
   friend std::ostream& operator<<(std::ostream& out, const Matrix& p);
   void Delete();
 
  private:
+  friend class ExpressionGraph;
+  friend class TiledMatrix;
+  friend class DistributedEngine;
+  friend class InverseUpdater;
+  friend class ResultCache;
+
+  static void MultiplyChain(
+      const std::vector<std::reference_wrapper<const Matrix>>& chain,
+      Matrix& result);
+
+  // LU factorization with partial pivoting, packed row-major
+  void Factorize(std::vector<double>& lu, std::vector<int>& pivots) const;
+  static Matrix SolveFactorized(const std::vector<double>& lu,
+                                const std::vector<int>& pivots,
+                                const Matrix& rhs);
+
+  // block kernels of the tiled and distributed LU factorizations
+  static void FactorTile(Matrix& tile);
+  static void SolveLowerUnit(const Matrix& factor, Matrix& tile);
+  static void SolveUpper(const Matrix& factor, Matrix& tile);
+
+  // reference-counted element block shared by copies, rows start
+  // col_capacity elements apart and row_capacity row pointers are kept
+  struct Storage {
+    std::atomic<int> references;
+    double** rows;
+    double* data;
+    size_t mapped_bytes;
+    int row_capacity, col_capacity;
+  };
+
+  Storage* Allocate(const Matrix* source, int row_capacity,
+                    int col_capacity) const;
+  void Attach(Storage* storage);
+  void Detach();
+  void Reallocate(int row_capacity, int col_capacity);
+
   // data members
   int rows_, cols_;
   double** matrix_;
+  Storage* storage_;
+  Allocation allocation_;
 };
 
+template <typename T>
+class Matrix::ElementIterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = double;
+  using difference_type = std::ptrdiff_t;
+  using pointer = T*;
+  using reference = T&;
+
+  ElementIterator() : rows_(nullptr), cols_(0), row_(0), col_(0) {}
+  ElementIterator(T* const* rows, int cols, int row, int col)
+      : rows_(rows), cols_(cols), row_(row), col_(col) {}
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  ElementIterator(const ElementIterator<U>& other)
+      : rows_(other.rows_),
+        cols_(other.cols_),
+        row_(other.row_),
+        col_(other.col_) {}
+
+  reference operator*() const { return rows_[row_][col_]; }
+  pointer operator->() const { return rows_[row_] + col_; }
+  reference operator[](difference_type n) const { return *(*this + n); }
+
+  ElementIterator& operator++() {
+    if (++col_ == cols_) {
+      col_ = 0;
+      ++row_;
+    }
+    return *this;
+  }
+  ElementIterator operator++(int) {
+    ElementIterator old = *this;
+    ++*this;
+    return old;
+  }
+  ElementIterator& operator--() {
+    if (col_ == 0) {
+      col_ = cols_;
+      --row_;
+    }
+    --col_;
+    return *this;
+  }
+  ElementIterator operator--(int) {
+    ElementIterator old = *this;
+    --*this;
+    return old;
+  }
+  ElementIterator& operator+=(difference_type n) {
+    Seek(Index() + n);
+    return *this;
+  }
+  ElementIterator& operator-=(difference_type n) {
+    Seek(Index() - n);
+    return *this;
+  }
+
+  friend ElementIterator operator+(ElementIterator it, difference_type n) {
+    return it += n;
+  }
+  friend ElementIterator operator+(difference_type n, ElementIterator it) {
+    return it += n;
+  }
+  friend ElementIterator operator-(ElementIterator it, difference_type n) {
+    return it -= n;
+  }
+  friend difference_type operator-(const ElementIterator& left,
+                                   const ElementIterator& right) {
+    return left.Index() - right.Index();
+  }
+  friend bool operator==(const ElementIterator& left,
+                         const ElementIterator& right) {
+    return left.row_ == right.row_ && left.col_ == right.col_;
+  }
+  friend std::strong_ordering operator<=>(const ElementIterator& left,
+                                          const ElementIterator& right) {
+    return left.Index() <=> right.Index();
+  }
+
+ private:
+  friend class ElementIterator<const double>;
+
+  difference_type Index() const {
+    return static_cast<difference_type>(row_) * cols_ + col_;
+  }
+  void Seek(difference_type index) {
+    row_ = cols_ ? static_cast<int>(index / cols_) : 0;
+    col_ = cols_ ? static_cast<int>(index % cols_) : 0;
+  }
+
+  T* const* rows_;
+  int cols_, row_, col_;
+};
+
+// the value type is a span, so legacy algorithms see an input iterator
+// while C++20 ranges see a random access one
+template <typename T>
+class Matrix::RowIterator {
+ public:
+  using iterator_concept = std::random_access_iterator_tag;
+  using iterator_category = std::input_iterator_tag;
+  using value_type = std::span<T>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = std::span<T>;
+
+  RowIterator() : rows_(nullptr), cols_(0), row_(0) {}
+  RowIterator(T* const* rows, int cols, int row)
+      : rows_(rows), cols_(cols), row_(row) {}
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  RowIterator(const RowIterator<U>& other)
+      : rows_(other.rows_), cols_(other.cols_), row_(other.row_) {}
+
+  reference operator*() const { return reference(rows_[row_], cols_); }
+  reference operator[](difference_type n) const {
+    return reference(rows_[row_ + n], cols_);
+  }
+
+  RowIterator& operator++() {
+    ++row_;
+    return *this;
+  }
+  RowIterator operator++(int) { return RowIterator(rows_, cols_, row_++); }
+  RowIterator& operator--() {
+    --row_;
+    return *this;
+  }
+  RowIterator operator--(int) { return RowIterator(rows_, cols_, row_--); }
+  RowIterator& operator+=(difference_type n) {
+    row_ += static_cast<int>(n);
+    return *this;
+  }
+  RowIterator& operator-=(difference_type n) {
+    row_ -= static_cast<int>(n);
+    return *this;
+  }
+
+  friend RowIterator operator+(RowIterator it, difference_type n) {
+    return it += n;
+  }
+  friend RowIterator operator+(difference_type n, RowIterator it) {
+    return it += n;
+  }
+  friend RowIterator operator-(RowIterator it, difference_type n) {
+    return it -= n;
+  }
+  friend difference_type operator-(const RowIterator& left,
+                                   const RowIterator& right) {
+    return left.row_ - right.row_;
+  }
+  friend bool operator==(const RowIterator& left, const RowIterator& right) {
+    return left.row_ == right.row_;
+  }
+  friend std::strong_ordering operator<=>(const RowIterator& left,
+                                          const RowIterator& right) {
+    return left.row_ <=> right.row_;
+  }
+
+ private:
+  friend class RowIterator<const double>;
+
+  T* const* rows_;
+  int cols_, row_;
+};
+
+template <typename T>
+class Matrix::RowRange {
+ public:
+  RowRange(RowIterator<T> first, RowIterator<T> last)
+      : first_(first), last_(last) {}
+
+  RowIterator<T> begin() const { return first_; }
+  RowIterator<T> end() const { return last_; }
+  std::size_t size() const { return last_ - first_; }
+
+ private:
+  RowIterator<T> first_, last_;
+};
+
+inline std::span<double> Matrix::operator[](int row_index) {
+  assert(row_index >= 0 && row_index < rows_);
+  Detach();
+  return std::span<double>(matrix_[row_index], cols_);
+}
+
+inline std::span<const double> Matrix::operator[](int row_index) const {
+  assert(row_index >= 0 && row_index < rows_);
+  return std::span<const double>(matrix_[row_index], cols_);
+}
+
 #endif  // SRC_MATRIX_OOP_H
\ No newline at end of file
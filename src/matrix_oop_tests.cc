@@ -1,6 +1,17 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <execution>
+#include <filesystem>
+#include <numeric>
+
+#include "matrix_cache.h"
+#include "matrix_distributed.h"
+#include "matrix_expression.h"
 #include "matrix_oop.h"
+#include "matrix_tiled.h"
+#include "matrix_updater.h"
 
 TEST(EqMatrix, True) {
   Matrix matrix_a(3, 3);
@@ -569,6 +580,699 @@ TEST(Set, True) {
   ASSERT_TRUE(matrix_c == result_c);
 }
 
+TEST(EigenSymmetric, True) {
+  Matrix matrix_a(3, 3);
+  Matrix values, vectors;
+
+  matrix_a(0, 0) = 2;
+  matrix_a(1, 1) = 3;
+  matrix_a(1, 2) = 4;
+  matrix_a(2, 1) = 4;
+  matrix_a(2, 2) = 9;
+
+  matrix_a.EigenSymmetric(values, vectors);
+  ASSERT_NEAR(values(0, 0), 1, 1e-9);
+  ASSERT_NEAR(values(1, 0), 2, 1e-9);
+  ASSERT_NEAR(values(2, 0), 11, 1e-9);
+
+  Matrix diagonal(3, 3);
+  for (int i = 0; i < 3; ++i) diagonal(i, i) = values(i, 0);
+  ASSERT_TRUE(matrix_a * vectors == vectors * diagonal);
+  Matrix identity(3, 3);
+  for (int i = 0; i < 3; ++i) identity(i, i) = 1;
+  ASSERT_TRUE(vectors.Transpose() * vectors == identity);
+}
+TEST(EigenSymmetric, False) {
+  Matrix matrix_a(2, 3);
+  Matrix matrix_b(2, 2);
+  Matrix values, vectors;
+  matrix_b(0, 1) = 1;
+  ASSERT_ANY_THROW(matrix_a.EigenSymmetric(values, vectors));
+  ASSERT_ANY_THROW(matrix_b.EigenSymmetric(values, vectors));
+  Matrix matrix_c(3, 3);
+  matrix_c(0, 0) = NAN;
+  matrix_c(1, 1) = 2;
+  matrix_c(2, 2) = 3;
+  ASSERT_ANY_THROW(matrix_c.EigenSymmetric(values, vectors));
+  matrix_c(0, 0) = 1;
+  matrix_c(0, 1) = NAN;
+  matrix_c(1, 0) = NAN;
+  ASSERT_ANY_THROW(matrix_c.EigenSymmetric(values, vectors));
+}
+TEST(Svd, True) {
+  Matrix matrix_a(4, 3);
+
+  matrix_a(0, 0) = 7;
+  matrix_a(0, 1) = -98;
+  matrix_a(0, 2) = 0.5;
+  matrix_a(1, 0) = 0;
+  matrix_a(1, 1) = 5.4;
+  matrix_a(1, 2) = 32;
+  matrix_a(2, 0) = 3.12;
+  matrix_a(2, 1) = 23;
+  matrix_a(2, 2) = 23;
+  matrix_a(3, 0) = -78;
+  matrix_a(3, 1) = 47.4;
+  matrix_a(3, 2) = 21;
+
+  Matrix matrix_b = matrix_a.Transpose();
+  for (const Matrix& matrix : {matrix_a, matrix_b}) {
+    Matrix u, s, v;
+    matrix.Svd(u, s, v);
+    ASSERT_EQ(s.GetRows(), 3);
+    Matrix diagonal(3, 3);
+    for (int i = 0; i < 3; ++i) diagonal(i, i) = s(i, 0);
+    ASSERT_TRUE(u * diagonal * v.Transpose() == matrix);
+    ASSERT_GE(s(0, 0), s(1, 0));
+    ASSERT_GE(s(1, 0), s(2, 0));
+  }
+
+  // rank one and zero matrices still get orthonormal columns in U
+  Matrix identity(3, 3);
+  for (int i = 0; i < 3; ++i) identity(i, i) = 1;
+  Matrix rank_one(4, 3);
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 3; ++j) rank_one(i, j) = (i + 1) * (j - 1.5);
+  }
+  for (const Matrix& matrix : {rank_one, Matrix(4, 3)}) {
+    Matrix u, s, v;
+    matrix.Svd(u, s, v);
+    ASSERT_TRUE(u.Transpose() * u == identity);
+    Matrix diagonal(3, 3);
+    for (int i = 0; i < 3; ++i) diagonal(i, i) = s(i, 0);
+    ASSERT_TRUE(u * diagonal * v.Transpose() == matrix);
+  }
+}
+TEST(Async, True) {
+  Matrix matrix_a(2, 2);
+  Matrix matrix_b(2, 2);
+
+  matrix_a(0, 0) = 3;
+  matrix_a(0, 1) = 2;
+  matrix_a(1, 0) = -6.6;
+  matrix_a(1, 1) = 1;
+
+  matrix_b(0, 0) = -7;
+  matrix_b(0, 1) = 0;
+  matrix_b(1, 0) = -3.5;
+  matrix_b(1, 1) = 2;
+
+  auto product = matrix_a.MulMatrixAsync(matrix_b);
+  auto inverse_a = matrix_a.InverseAsync();
+  auto inverse_b = matrix_b.InverseAsync();
+  auto chained = Matrix::InverseAsync(product);
+  auto reversed = Matrix::MulMatrixAsync(inverse_b, inverse_a);
+  ASSERT_TRUE(product.get() == matrix_a * matrix_b);
+  ASSERT_TRUE(chained.get() == reversed.get());
+}
+TEST(Async, False) {
+  Matrix matrix_a(2, 3);
+  Matrix matrix_b(2, 2);
+  ASSERT_ANY_THROW(matrix_a.MulMatrixAsync(matrix_b).get());
+  ASSERT_ANY_THROW(matrix_b.InverseAsync().get());
+  ASSERT_ANY_THROW(
+      Matrix::InverseAsync(matrix_a.MulMatrixAsync(matrix_b)).get());
+}
+TEST(Expression, True) {
+  Matrix matrix_a(3, 2);
+  Matrix matrix_b(2, 3);
+  Matrix matrix_c(3, 3);
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      matrix_a(i, j) = i - 2 * j + 0.5;
+      matrix_b(j, i) = i * j - 1;
+    }
+    for (int j = 0; j < 3; ++j) matrix_c(i, j) = i + j;
+  }
+
+  ExpressionGraph graph;
+  Expression a = graph.Input(matrix_a);
+  Expression b = graph.Input(matrix_b);
+  Expression c = graph.Input(matrix_c);
+  Expression shared = a * b + c;
+  Expression first = shared * c * 2 - (c + a * b);
+  Expression second = (b.Transpose() * a.Transpose()).Transpose() * shared;
+  ASSERT_EQ(graph.GetNodesCount(), 13);
+
+  Matrix shared_result = matrix_a * matrix_b + matrix_c;
+  std::vector<Matrix> results = graph.Evaluate({first, second, shared, a});
+  ASSERT_TRUE(results[0] == shared_result * matrix_c * 2 - shared_result);
+  ASSERT_TRUE(results[1] == matrix_a * matrix_b * shared_result);
+  ASSERT_TRUE(results[2] == shared_result);
+  ASSERT_TRUE(results[3] == matrix_a);
+  ASSERT_TRUE(first.Evaluate() == results[0]);
+}
+TEST(Expression, False) {
+  ExpressionGraph graph;
+  ExpressionGraph other;
+  Expression a = graph.Input(Matrix(2, 3));
+  Expression b = graph.Input(Matrix(2, 2));
+  Expression c = other.Input(Matrix(2, 3));
+  ASSERT_ANY_THROW(a + b);
+  ASSERT_ANY_THROW(a * b);
+  ASSERT_ANY_THROW(a - c);
+  ASSERT_ANY_THROW(graph.Evaluate(c));
+}
+TEST(MultiplyChain, True) {
+  Matrix matrix_a(5, 1);
+  Matrix matrix_b(1, 4);
+  Matrix matrix_c(4, 2);
+  Matrix matrix_d(2, 3);
+  for (int i = 0; i < 5; ++i) matrix_a(i, 0) = i - 1.5;
+  for (int j = 0; j < 4; ++j) matrix_b(0, j) = j * 2;
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 2; ++j) matrix_c(i, j) = i + j * 0.25;
+  }
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 3; ++j) matrix_d(i, j) = i - j;
+  }
+
+  Matrix result =
+      Matrix::MultiplyChain({matrix_a, matrix_b, matrix_c, matrix_d});
+  ASSERT_TRUE(result == matrix_a * matrix_b * matrix_c * matrix_d);
+  ASSERT_TRUE(Matrix::MultiplyChain({matrix_c}) == matrix_c);
+}
+TEST(MultiplyChain, False) {
+  Matrix matrix_a(2, 3);
+  Matrix matrix_b(2, 2);
+  ASSERT_ANY_THROW(Matrix::MultiplyChain({matrix_a, matrix_b}));
+  ASSERT_ANY_THROW(Matrix::MultiplyChain({}));
+}
+TEST(Solve, True) {
+  Matrix matrix_a(3, 3);
+  Matrix rhs(3, 2);
+
+  matrix_a(0, 0) = 2;
+  matrix_a(0, 1) = 5;
+  matrix_a(0, 2) = 7;
+  matrix_a(1, 0) = 6;
+  matrix_a(1, 1) = 3;
+  matrix_a(1, 2) = 4;
+  matrix_a(2, 0) = 5;
+  matrix_a(2, 1) = -2;
+  matrix_a(2, 2) = -3;
+
+  rhs(0, 0) = 1;
+  rhs(1, 0) = 2;
+  rhs(2, 0) = 3;
+  rhs(0, 1) = 0.1;
+  rhs(1, 1) = -7;
+  rhs(2, 1) = 1e3;
+
+  ASSERT_TRUE(matrix_a * matrix_a.Solve(rhs) == rhs);
+  int iterations = 0;
+  Matrix solution = matrix_a.SolveMixed(rhs, iterations);
+  ASSERT_TRUE(matrix_a * solution == rhs);
+  ASSERT_GE(iterations, 0);
+  ASSERT_TRUE(matrix_a.InverseMixed(iterations) == matrix_a.InverseMatrix());
+}
+TEST(Solve, Fallback) {
+  Matrix matrix_a(2, 2);
+  Matrix rhs(2, 1);
+
+  matrix_a(0, 0) = 1;
+  matrix_a(0, 1) = 1;
+  matrix_a(1, 0) = 1;
+  matrix_a(1, 1) = 1 + 1e-12;
+  rhs(0, 0) = 2;
+  rhs(1, 0) = 2 + 1e-12;
+
+  int iterations = 0;
+  Matrix solution = matrix_a.SolveMixed(rhs, iterations);
+  ASSERT_EQ(iterations, -1);
+  ASSERT_NEAR(solution(0, 0), 1, 1e-3);
+  ASSERT_NEAR(solution(1, 0), 1, 1e-3);
+}
+TEST(Solve, False) {
+  Matrix matrix_a(2, 2);
+  Matrix matrix_b(2, 3);
+  Matrix rhs(3, 1);
+  int iterations = 0;
+  ASSERT_ANY_THROW(matrix_a.Solve(Matrix(2, 1)));
+  ASSERT_ANY_THROW(matrix_a.SolveMixed(Matrix(2, 1), iterations));
+  ASSERT_ANY_THROW(matrix_b.InverseMixed(iterations));
+  ASSERT_ANY_THROW(matrix_a.Solve(rhs));
+}
+TEST(Allocation, True) {
+  Matrix matrix_a(512, 512, Matrix::Allocation::kHugePages);
+  Matrix matrix_b(512, 512, Matrix::Allocation::kHeap);
+  for (int i = 0; i < 512; ++i) {
+    matrix_a(i, (i * 7) % 512) = i;
+    matrix_b(i, (i * 7) % 512) = i;
+  }
+  ASSERT_TRUE(matrix_a == matrix_b);
+
+  Matrix copy(matrix_a);
+  ASSERT_EQ(copy.GetAllocation(), Matrix::Allocation::kHugePages);
+  ASSERT_TRUE(copy == matrix_b);
+  copy.SetRows(3);
+  ASSERT_EQ(copy.GetAllocation(), Matrix::Allocation::kHugePages);
+  ASSERT_EQ(copy(2, 14), 2);
+  // the policy carries over, the 3 x 4 product itself is below one huge
+  // page and lives on the heap
+  copy *= Matrix(512, 4);
+  ASSERT_EQ(copy.GetAllocation(), Matrix::Allocation::kHugePages);
+
+  Matrix::SetDefaultAllocation(Matrix::Allocation::kHeap);
+  ASSERT_EQ(Matrix(2, 2).GetAllocation(), Matrix::Allocation::kHeap);
+  Matrix::SetDefaultAllocation(Matrix::Allocation::kAuto);
+  ASSERT_EQ(Matrix::GetDefaultAllocation(), Matrix::Allocation::kAuto);
+}
+TEST(TiledMatrix, True) {
+  Matrix matrix_a(5, 7);
+  Matrix matrix_b(7, 3);
+  for (int i = 0; i < 7; ++i) {
+    for (int j = 0; j < 5; ++j) matrix_a(j, i) = i - j * 0.5;
+    for (int j = 0; j < 3; ++j) matrix_b(i, j) = i * j + 1;
+  }
+  size_t budget = 3 * 4 * sizeof(double);
+  {
+    TiledMatrix tiled_a("tiled_a.bin", 5, 7, 2, budget);
+    TiledMatrix tiled_b("tiled_b.bin", 7, 3, 2, budget);
+    TiledMatrix tiled_c("tiled_c.bin", 5, 3, 2, budget);
+    TiledMatrix tiled_t("tiled_t.bin", 7, 5, 2, budget);
+    tiled_a.Load(matrix_a);
+    tiled_b.Load(matrix_b);
+    TiledMatrix::Multiply(tiled_a, tiled_b, tiled_c);
+    tiled_a.Transpose(tiled_t);
+    ASSERT_TRUE(tiled_c.ToMatrix() == matrix_a * matrix_b);
+    ASSERT_TRUE(tiled_t.ToMatrix() == matrix_a.Transpose());
+    ASSERT_GT(tiled_a.GetCacheMisses(), 0u);
+    ASSERT_EQ(tiled_a.GetTileRows(), 3);
+    ASSERT_EQ(tiled_a.GetTileCols(), 4);
+  }
+  {
+    TiledMatrix reopened("tiled_a.bin", 5, 7, 2, budget);
+    ASSERT_TRUE(reopened.ToMatrix() == matrix_a);
+  }
+
+  Matrix matrix_s(5, 5);
+  for (int i = 0; i < 5; ++i) {
+    for (int j = 0; j < 5; ++j) matrix_s(i, j) = (i == j) ? 10 : i - j * 0.3;
+  }
+  {
+    TiledMatrix tiled_s("tiled_s.bin", 5, 5, 2, budget);
+    tiled_s.Load(matrix_s);
+    tiled_s.FactorLu();
+    Matrix factors = tiled_s.ToMatrix();
+    Matrix lower(5, 5), upper(5, 5);
+    for (int i = 0; i < 5; ++i) {
+      for (int j = 0; j < 5; ++j) {
+        if (i > j) lower(i, j) = factors(i, j);
+        if (i <= j) upper(i, j) = factors(i, j);
+      }
+      lower(i, i) = 1;
+    }
+    ASSERT_TRUE(lower * upper == matrix_s);
+  }
+  for (const char* path :
+       {"tiled_a.bin", "tiled_b.bin", "tiled_c.bin", "tiled_t.bin",
+        "tiled_s.bin"}) {
+    std::remove(path);
+  }
+}
+TEST(TiledMatrix, False) {
+  {
+    TiledMatrix tiled_a("tiled_a.bin", 4, 4, 2, 1 << 10);
+    TiledMatrix tiled_b("tiled_b.bin", 3, 4, 2, 1 << 10);
+    ASSERT_ANY_THROW(tiled_a.GetTile(2, 0));
+    ASSERT_ANY_THROW(tiled_a.SetTile(0, 0, Matrix(3, 2)));
+    ASSERT_ANY_THROW(TiledMatrix::Multiply(tiled_a, tiled_b, tiled_a));
+    ASSERT_ANY_THROW(tiled_b.FactorLu());
+    ASSERT_ANY_THROW(tiled_a.FactorLu());
+    ASSERT_ANY_THROW(TiledMatrix("tiled_a.bin", 4, 2, 2, 1 << 10));
+    ASSERT_ANY_THROW(TiledMatrix("tiled_a.bin", 4, 4, 3, 1 << 10));
+    // a failed prefetch does not stick to the tile
+    TiledMatrix tiled_c("tiled_c.bin", 4, 4, 2, 1 << 10);
+    std::filesystem::resize_file("tiled_c.bin", 0);
+    tiled_c.Prefetch(0, 0);
+    ASSERT_ANY_THROW(tiled_c.GetTile(0, 0));
+    std::filesystem::resize_file("tiled_c.bin", 16 * sizeof(double));
+    ASSERT_TRUE(tiled_c.GetTile(0, 0) == Matrix(2, 2));
+  }
+  std::remove("tiled_a.bin");
+  std::remove("tiled_b.bin");
+  std::remove("tiled_c.bin");
+  ASSERT_ANY_THROW(TiledMatrix("missing/tiled.bin", 2, 2, 1, 1 << 10));
+}
+TEST(Distributed, True) {
+  Matrix matrix_a(7, 5);
+  Matrix matrix_b(5, 6);
+  Matrix matrix_s(7, 7);
+  for (int i = 0; i < 7; ++i) {
+    for (int j = 0; j < 5; ++j) matrix_a(i, j) = i * 0.5 - j;
+    for (int j = 0; j < 7; ++j) matrix_s(i, j) = (i == j) ? 20 : i - j * 0.7;
+  }
+  for (int i = 0; i < 5; ++i) {
+    for (int j = 0; j < 6; ++j) matrix_b(i, j) = i + j * j;
+  }
+
+  SocketTransport transport(4);
+  DistributedEngine engine(transport, 2);
+  ASSERT_TRUE(engine.MulMatrix(matrix_a, matrix_b) == matrix_a * matrix_b);
+
+  Matrix factors = engine.FactorLu(matrix_s);
+  Matrix lower(7, 7), upper(7, 7);
+  for (int i = 0; i < 7; ++i) {
+    for (int j = 0; j < 7; ++j) {
+      if (i > j) lower(i, j) = factors(i, j);
+      if (i <= j) upper(i, j) = factors(i, j);
+    }
+    lower(i, i) = 1;
+  }
+  ASSERT_TRUE(lower * upper == matrix_s);
+
+  SocketTransport single(1);
+  DistributedEngine small(single, 3);
+  ASSERT_TRUE(small.MulMatrix(matrix_b.Transpose(), matrix_b) ==
+              matrix_b.Transpose() * matrix_b);
+}
+TEST(Distributed, False) {
+  SocketTransport transport(2);
+  ASSERT_ANY_THROW(DistributedEngine(transport, 0));
+  DistributedEngine engine(transport, 2);
+  ASSERT_ANY_THROW(engine.MulMatrix(Matrix(2, 3), Matrix(2, 3)));
+  ASSERT_ANY_THROW(engine.FactorLu(Matrix(2, 3)));
+  ASSERT_ANY_THROW(SocketTransport(0));
+
+  // a failed factorization must not leave blocks behind for the next call
+  SocketTransport single(1);
+  DistributedEngine reused(single, 1);
+  Matrix singular(3, 3);
+  singular(0, 0) = 1;
+  singular(0, 1) = 2;
+  singular(1, 0) = 2;
+  singular(1, 1) = 4;
+  singular(2, 2) = 1;
+  ASSERT_ANY_THROW(reused.FactorLu(singular));
+  Matrix identity(3, 3);
+  for (int i = 0; i < 3; ++i) identity(i, i) = 1;
+  ASSERT_TRUE(reused.MulMatrix(identity, identity * 2) == identity * 2);
+}
+TEST(CopyOnWrite, True) {
+  Matrix matrix_a(2, 2);
+  matrix_a(0, 0) = 3;
+  matrix_a(1, 1) = -6.6;
+
+  Matrix copy(matrix_a);
+  Matrix assigned;
+  assigned = matrix_a;
+  ASSERT_TRUE(matrix_a.IsShared());
+  ASSERT_TRUE(copy == matrix_a);
+
+  copy(0, 1) = 2;
+  ASSERT_FALSE(copy.IsShared());
+  ASSERT_EQ(matrix_a(0, 1), 0);
+  assigned += copy;
+  ASSERT_EQ(assigned(0, 0), 6);
+  ASSERT_EQ(matrix_a(0, 0), 3);
+  ASSERT_FALSE(matrix_a.IsShared());
+
+  const Matrix shared(matrix_a);
+  ASSERT_EQ(shared(1, 1), -6.6);
+  ASSERT_TRUE(matrix_a.IsShared());
+  Matrix clone = shared.Clone();
+  ASSERT_FALSE(clone.IsShared());
+  ASSERT_TRUE(clone == shared);
+  matrix_a.MulNumber(2);
+  ASSERT_EQ(shared(0, 0), 3);
+  ASSERT_EQ(matrix_a(0, 0), 6);
+}
+TEST(InverseUpdater, True) {
+  Matrix matrix_a(3, 3);
+
+  matrix_a(0, 0) = 2;
+  matrix_a(0, 1) = 5;
+  matrix_a(0, 2) = 7;
+  matrix_a(1, 0) = 6;
+  matrix_a(1, 1) = 3;
+  matrix_a(1, 2) = 4;
+  matrix_a(2, 0) = 5;
+  matrix_a(2, 1) = -2;
+  matrix_a(2, 2) = -3;
+
+  InverseUpdater updater(matrix_a, 4);
+  ASSERT_TRUE(updater.GetInverse() == matrix_a.InverseMatrix());
+  ASSERT_NEAR(updater.GetDeterminant(), -1, 1e-9);
+
+  updater.SetElement(1, 2, 9);
+  matrix_a(1, 2) = 9;
+  ASSERT_TRUE(updater.GetInverse() == matrix_a.InverseMatrix());
+  ASSERT_NEAR(updater.GetDeterminant(), matrix_a.Determinant(), 1e-9);
+
+  Matrix row(1, 3);
+  row(0, 0) = 1;
+  row(0, 1) = -4;
+  row(0, 2) = 0.5;
+  updater.SetRow(2, row);
+  Matrix col(3, 1);
+  col(0, 0) = 3;
+  col(1, 0) = 1;
+  col(2, 0) = 8;
+  updater.SetCol(0, col);
+  for (int j = 0; j < 3; ++j) matrix_a(2, j) = row(0, j);
+  for (int i = 0; i < 3; ++i) matrix_a(i, 0) = col(i, 0);
+  ASSERT_TRUE(updater.GetMatrix() == matrix_a);
+  ASSERT_TRUE(updater.GetInverse() == matrix_a.InverseMatrix());
+  ASSERT_NEAR(updater.GetDeterminant(), matrix_a.Determinant(), 1e-9);
+
+  Matrix u(3, 2), v(3, 2);
+  u(0, 0) = 1;
+  u(2, 1) = -2;
+  v(1, 0) = 0.5;
+  v(0, 1) = 1;
+  v(2, 1) = 3;
+  updater.Update(u, v);
+  matrix_a += u * v.Transpose();
+  ASSERT_TRUE(updater.GetMatrix() == matrix_a);
+  ASSERT_TRUE(updater.GetInverse() == matrix_a.InverseMatrix());
+  ASSERT_NEAR(updater.GetDeterminant(), matrix_a.Determinant(), 1e-9);
+}
+TEST(InverseUpdater, False) {
+  Matrix matrix_a(2, 2);
+  ASSERT_ANY_THROW(InverseUpdater(Matrix(2, 3)));
+  ASSERT_ANY_THROW(InverseUpdater{matrix_a});
+  matrix_a(0, 0) = 1;
+  matrix_a(1, 1) = 1;
+  InverseUpdater updater(matrix_a);
+  ASSERT_ANY_THROW(updater.SetElement(2, 0, 1));
+  ASSERT_ANY_THROW(updater.SetRow(0, Matrix(2, 1)));
+  ASSERT_ANY_THROW(updater.Update(Matrix(2, 2), Matrix(3, 2)));
+  ASSERT_ANY_THROW(updater.SetElement(1, 1, 0));
+  ASSERT_TRUE(updater.GetMatrix() == matrix_a);
+  ASSERT_EQ(updater.GetDeterminant(), 1);
+}
+
+TEST(ResultCache, True) {
+  Matrix matrix_a(3, 3);
+
+  matrix_a(0, 0) = 2;
+  matrix_a(0, 1) = 5;
+  matrix_a(0, 2) = 7;
+  matrix_a(1, 0) = 6;
+  matrix_a(1, 1) = 3;
+  matrix_a(1, 2) = 4;
+  matrix_a(2, 0) = 5;
+  matrix_a(2, 1) = -2;
+  matrix_a(2, 2) = -3;
+
+  Matrix rhs(3, 1);
+  rhs(0, 0) = 1;
+  rhs(1, 0) = 2;
+  rhs(2, 0) = 3;
+
+  ResultCache cache(1 << 20);
+  ASSERT_EQ(cache.Determinant(matrix_a), matrix_a.Determinant());
+  ASSERT_EQ(cache.Determinant(matrix_a), matrix_a.Determinant());
+  ASSERT_TRUE(cache.InverseMatrix(matrix_a) == matrix_a.InverseMatrix());
+  ASSERT_TRUE(cache.Solve(matrix_a, rhs) == matrix_a.Solve(rhs));
+  ASSERT_TRUE(cache.Solve(Matrix(matrix_a), rhs) == matrix_a.Solve(rhs));
+  ASSERT_EQ(cache.GetHits(), 2);
+  ASSERT_EQ(cache.GetMisses(), 3);
+  ASSERT_EQ(ResultCache::Hash(matrix_a), ResultCache::Hash(Matrix(matrix_a)));
+
+  matrix_a(1, 1) = 4;
+  ASSERT_EQ(cache.Determinant(matrix_a), matrix_a.Determinant());
+  ASSERT_EQ(cache.GetMisses(), 4);
+
+  ResultCache small(100);
+  small.Determinant(matrix_a);
+  small.Determinant(Matrix(2, 2));
+  small.Determinant(matrix_a);
+  ASSERT_EQ(small.GetHits(), 0);
+  ASSERT_LE(small.GetBytes(), 100);
+  small.Clear();
+  ASSERT_EQ(small.GetBytes(), 0);
+
+  Matrix large(30, 30);
+  for (int i = 0; i < 30; ++i) large(i, i) = 2;
+  ResultCache bounded(1000);
+  ASSERT_EQ(bounded.Determinant(large), large.Determinant());
+  ASSERT_TRUE(bounded.InverseMatrix(matrix_a) == matrix_a.InverseMatrix());
+  ASSERT_TRUE(bounded.Solve(large, Matrix(30, 1)) == Matrix(30, 1));
+  ASSERT_LE(bounded.GetBytes(), 1000);
+  ASSERT_EQ(bounded.GetHits(), 0);
+}
+TEST(ResultCache, False) {
+  ResultCache cache(1 << 20);
+  ASSERT_ANY_THROW(cache.Determinant(Matrix(2, 3)));
+  ASSERT_ANY_THROW(cache.InverseMatrix(Matrix(2, 2)));
+  ASSERT_ANY_THROW(cache.Solve(Matrix(2, 2), Matrix(2, 1)));
+  ASSERT_ANY_THROW(cache.Solve(Matrix(2, 2), Matrix(3, 1)));
+  ASSERT_EQ(cache.GetBytes(), 0);
+}
+
+TEST(Iterators, True) {
+  static_assert(std::random_access_iterator<Matrix::iterator>);
+  static_assert(std::random_access_iterator<Matrix::const_row_iterator>);
+  Matrix matrix_a(3, 4);
+  for (int i = 0; i < 3; ++i) {
+    std::span<double> row = matrix_a[i];
+    for (int j = 0; j < 4; ++j) row[j] = i * 4 + j;
+  }
+  ASSERT_EQ(matrix_a(2, 1), 9);
+  ASSERT_EQ(matrix_a.end() - matrix_a.begin(), 12);
+  ASSERT_EQ(matrix_a.begin()[5], 5);
+  ASSERT_EQ(*(matrix_a.end() - 1), 11);
+  ASSERT_EQ(std::reduce(std::execution::par, matrix_a.cbegin(),
+                        matrix_a.cend()),
+            66);
+
+  Matrix matrix_b = matrix_a;
+  std::transform(std::execution::par_unseq, matrix_b.begin(),
+                 matrix_b.end(), matrix_b.begin(),
+                 [](double value) { return value * 2; });
+  ASSERT_TRUE(matrix_b == matrix_a * 2);
+  ASSERT_EQ(matrix_a(1, 1), 5);
+
+  int count = 0;
+  for (std::span<double> row : matrix_b.Rows()) {
+    std::fill(row.begin(), row.end(), count++);
+  }
+  const Matrix& view = matrix_b;
+  ASSERT_EQ(view[2][3], 2);
+  ASSERT_EQ(std::ranges::distance(view.Rows()), 3);
+  ASSERT_EQ(std::accumulate(view.begin(), view.end(), 0.0), 12);
+  Matrix::const_iterator first = matrix_b.begin();
+  ASSERT_TRUE(first < view.end());
+}
+
+TEST(Reductions, True) {
+  Matrix matrix_a(3, 5);
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 5; ++j) matrix_a(i, j) = (i - 1) * 5 + j - 2;
+  }
+  matrix_a(2, 4) = -9;
+  int row = -1, col = -1;
+  ASSERT_EQ(matrix_a.Sum(), -16);
+  ASSERT_EQ(matrix_a.Min(row, col), -9);
+  ASSERT_EQ(row, 2);
+  ASSERT_EQ(col, 4);
+  ASSERT_EQ(matrix_a.Max(row, col), 6);
+  ASSERT_EQ(row, 2);
+  ASSERT_EQ(col, 3);
+  ASSERT_EQ(matrix_a.NormOne(), 14);
+  ASSERT_EQ(matrix_a.NormInf(), 27);
+  ASSERT_NEAR(matrix_a.NormFrobenius(), sqrt(312), 1e-12);
+
+  Matrix matrix_b(2, 2);
+  matrix_b(0, 0) = 3;
+  matrix_b(0, 1) = 3;
+  matrix_b(1, 0) = 3;
+  matrix_b(1, 1) = -0.5;
+  ASSERT_EQ(matrix_b.Trace(), 2.5);
+  ASSERT_EQ(matrix_b.Max(row, col), 3);
+  ASSERT_EQ(row, 0);
+  ASSERT_EQ(col, 0);
+
+  Matrix matrix_c(1, 9);
+  matrix_c(0, 0) = 1e16;
+  matrix_c(0, 8) = -1e16;
+  for (int j = 1; j < 8; ++j) matrix_c(0, j) = 1;
+  ASSERT_EQ(matrix_c.Sum(), 7);
+
+  Matrix matrix_d = matrix_a;
+  matrix_d(1, 2) += 0.25;
+  ASSERT_EQ(matrix_a.MaxAbsDiff(matrix_d), 0.25);
+  ASSERT_FALSE(matrix_a == matrix_d);
+  matrix_d(1, 2) = NAN;
+  ASSERT_TRUE(std::isnan(matrix_a.MaxAbsDiff(matrix_d)));
+  ASSERT_EQ(matrix_d.Min(), -9);
+
+  Matrix matrix_e(2, 2);
+  matrix_e(0, 0) = 1e200;
+  ASSERT_NEAR(matrix_e.NormFrobenius() / 1e200, 1, 1e-15);
+  matrix_e(1, 1) = 1e200;
+  ASSERT_NEAR(matrix_e.NormFrobenius() / 1e200, sqrt(2), 1e-15);
+  matrix_e(0, 0) = 3e-200;
+  matrix_e(1, 1) = 4e-200;
+  ASSERT_NEAR(matrix_e.NormFrobenius() / 5e-200, 1, 1e-15);
+  matrix_e(0, 1) = INFINITY;
+  ASSERT_EQ(matrix_e.NormFrobenius(), INFINITY);
+}
+TEST(Reductions, False) {
+  ASSERT_ANY_THROW(Matrix(2, 3).Trace());
+  ASSERT_ANY_THROW(Matrix(2, 3).MaxAbsDiff(Matrix(3, 2)));
+}
+
+TEST(Capacity, True) {
+  Matrix matrix_a(1, 3);
+  Matrix row(1, 3);
+  for (int i = 0; i < 100; ++i) {
+    for (int j = 0; j < 3; ++j) row(0, j) = i * 3 + j;
+    matrix_a.AppendRow(row);
+  }
+  ASSERT_EQ(matrix_a.GetRows(), 101);
+  ASSERT_EQ(matrix_a.GetRowCapacity(), 128);
+  ASSERT_EQ(matrix_a(100, 2), 299);
+  ASSERT_EQ(matrix_a(0, 0), 0);
+
+  const double* first = &matrix_a(0, 0);
+  matrix_a.SetRows(50);
+  matrix_a.SetCols(2);
+  ASSERT_EQ(&matrix_a(0, 0), first);
+  ASSERT_EQ(matrix_a.GetRowCapacity(), 128);
+  ASSERT_EQ(matrix_a.GetColCapacity(), 3);
+  matrix_a.SetCols(3);
+  matrix_a.SetRows(51);
+  ASSERT_EQ(&matrix_a(0, 0), first);
+  ASSERT_EQ(matrix_a(10, 1), 28);
+  ASSERT_EQ(matrix_a(10, 2), 0);
+  ASSERT_EQ(matrix_a(50, 0), 0);
+
+  Matrix copy = matrix_a;
+  matrix_a.AppendRows(matrix_a);
+  ASSERT_EQ(matrix_a.GetRows(), 102);
+  ASSERT_EQ(copy.GetRows(), 51);
+  ASSERT_EQ(matrix_a(61, 1), matrix_a(10, 1));
+  matrix_a.ShrinkToFit();
+  ASSERT_EQ(matrix_a.GetRowCapacity(), 102);
+  ASSERT_EQ(matrix_a.GetColCapacity(), 3);
+
+  Matrix tile(2, 2);
+  tile.Reserve(4, 4);
+  ASSERT_EQ(tile.GetColCapacity(), 4);
+  tile(0, 1) = 1;
+  tile(1, 0) = 2;
+  {
+    TiledMatrix tiled("tiled_capacity.bin", 2, 2, 2, 0);
+    tiled.SetTile(0, 0, tile);
+  }
+  {
+    TiledMatrix reopened("tiled_capacity.bin", 2, 2, 2, 0);
+    ASSERT_TRUE(reopened.ToMatrix() == tile);
+  }
+  std::remove("tiled_capacity.bin");
+}
+TEST(Capacity, False) {
+  Matrix matrix_a(2, 3);
+  ASSERT_ANY_THROW(matrix_a.AppendRow(Matrix(2, 3)));
+  ASSERT_ANY_THROW(matrix_a.AppendRows(Matrix(2, 2)));
+  ASSERT_ANY_THROW(matrix_a.Reserve(0, 3));
+  ASSERT_ANY_THROW(matrix_a.SetCols(0));
+  ASSERT_EQ(matrix_a.GetRows(), 2);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,339 @@
+#include "matrix_tiled.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+TiledMatrix::TiledMatrix(const std::string& path, int rows, int cols,
+                         int tile_size, size_t memory_budget)
+    : rows_(rows),
+      cols_(cols),
+      tile_size_(tile_size),
+      tile_rows_(0),
+      tile_cols_(0),
+      memory_budget_(memory_budget),
+      cached_bytes_(0),
+      hits_(0),
+      misses_(0),
+      fd_(-1) {
+  if (rows <= 0 || cols <= 0 || tile_size <= 0) {
+    throw std::exception();
+  }
+  tile_rows_ = (rows_ + tile_size_ - 1) / tile_size_;
+  tile_cols_ = (cols_ + tile_size_ - 1) / tile_size_;
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    throw std::exception();
+  }
+  off_t size = static_cast<off_t>(tile_rows_) * tile_cols_ * tile_size_ *
+               tile_size_ * sizeof(double);
+  // a file written with another geometry would be truncated or read with
+  // the wrong tile layout
+  struct stat status;
+  if (fstat(fd_, &status) != 0 ||
+      (status.st_size != 0 && status.st_size != size) ||
+      (status.st_size == 0 && ftruncate(fd_, size) != 0)) {
+    close(fd_);
+    throw std::exception();
+  }
+}
+
+TiledMatrix::~TiledMatrix() {
+  try {
+    Flush();
+  } catch (...) {
+  }
+  pending_.clear();
+  close(fd_);
+}
+
+Matrix TiledMatrix::GetTile(int tile_row, int tile_col) {
+  return Fetch(tile_row, tile_col).tile;
+}
+
+void TiledMatrix::SetTile(int tile_row, int tile_col, const Matrix& tile) {
+  CheckTile(tile_row, tile_col);
+  Key key(tile_row, tile_col);
+  int height = std::min(tile_size_, rows_ - tile_row * tile_size_);
+  int width = std::min(tile_size_, cols_ - tile_col * tile_size_);
+  if (tile.rows_ != height || tile.cols_ != width) {
+    throw std::exception();
+  }
+  // a read started before this write would bring back stale data
+  auto pending = pending_.find(key);
+  if (pending != pending_.end()) {
+    pending->second.wait();
+    pending_.erase(pending);
+    cached_bytes_ -= TileBytes(tile_row, tile_col);
+  }
+  auto found = cache_.find(key);
+  if (found != cache_.end()) {
+    found->second.tile = tile;
+    found->second.dirty = true;
+    lru_.splice(lru_.begin(), lru_, found->second.position);
+  } else {
+    Insert(key, Matrix(tile), true);
+  }
+}
+
+void TiledMatrix::Prefetch(int tile_row, int tile_col) {
+  CheckTile(tile_row, tile_col);
+  Key key(tile_row, tile_col);
+  if (cache_.count(key) || pending_.count(key)) return;
+  // the tile is charged against the budget from the start of the read
+  Evict(TileBytes(tile_row, tile_col));
+  cached_bytes_ += TileBytes(tile_row, tile_col);
+  pending_.emplace(key, std::async(std::launch::async,
+                                   [this, tile_row, tile_col] {
+                                     return ReadTile(tile_row, tile_col);
+                                   })
+                            .share());
+}
+
+void TiledMatrix::Flush() {
+  for (auto& entry : cache_) {
+    if (entry.second.dirty) {
+      WriteTile(entry.first.first, entry.first.second, entry.second.tile);
+      entry.second.dirty = false;
+    }
+  }
+}
+
+void TiledMatrix::Load(const Matrix& matrix) {
+  if (matrix.rows_ != rows_ || matrix.cols_ != cols_) {
+    throw std::exception();
+  }
+  for (int tr = 0; tr < tile_rows_; ++tr) {
+    for (int tc = 0; tc < tile_cols_; ++tc) {
+      int height = std::min(tile_size_, rows_ - tr * tile_size_);
+      int width = std::min(tile_size_, cols_ - tc * tile_size_);
+      Matrix tile(height, width, Matrix::Allocation::kHeap);
+      for (int i = 0; i < height; ++i) {
+        const double* source = matrix.matrix_[tr * tile_size_ + i];
+        std::copy(source + tc * tile_size_, source + tc * tile_size_ + width,
+                  tile.matrix_[i]);
+      }
+      SetTile(tr, tc, tile);
+    }
+  }
+}
+
+Matrix TiledMatrix::ToMatrix() {
+  Matrix result(rows_, cols_);
+  for (int tr = 0; tr < tile_rows_; ++tr) {
+    for (int tc = 0; tc < tile_cols_; ++tc) {
+      Matrix tile = GetTile(tr, tc);
+      for (int i = 0; i < tile.rows_; ++i) {
+        std::copy(tile.matrix_[i], tile.matrix_[i] + tile.cols_,
+                  result.matrix_[tr * tile_size_ + i] + tc * tile_size_);
+      }
+    }
+  }
+  return result;
+}
+
+void TiledMatrix::Multiply(TiledMatrix& left, TiledMatrix& right,
+                           TiledMatrix& result) {
+  if (left.cols_ != right.rows_ || result.rows_ != left.rows_ ||
+      result.cols_ != right.cols_ || left.tile_size_ != right.tile_size_ ||
+      left.tile_size_ != result.tile_size_ || &result == &left ||
+      &result == &right) {
+    throw std::exception();
+  }
+  // every step reads one tile of each operand, the tiles of the next step
+  // are requested before the current product is computed
+  std::vector<std::tuple<int, int, int>> steps;
+  for (int tr = 0; tr < result.tile_rows_; ++tr) {
+    for (int tc = 0; tc < result.tile_cols_; ++tc) {
+      for (int k = 0; k < left.tile_cols_; ++k) steps.emplace_back(tr, tc, k);
+    }
+  }
+  Matrix accumulator;
+  for (size_t step = 0; step < steps.size(); ++step) {
+    int tr, tc, k;
+    std::tie(tr, tc, k) = steps[step];
+    if (step + 1 < steps.size()) {
+      int next_tr, next_tc, next_k;
+      std::tie(next_tr, next_tc, next_k) = steps[step + 1];
+      left.Prefetch(next_tr, next_k);
+      right.Prefetch(next_k, next_tc);
+    }
+    Matrix product = left.GetTile(tr, k) * right.GetTile(k, tc);
+    if (k == 0) {
+      accumulator = std::move(product);
+    } else {
+      accumulator += product;
+    }
+    if (k == left.tile_cols_ - 1) result.SetTile(tr, tc, accumulator);
+  }
+}
+
+void TiledMatrix::Transpose(TiledMatrix& result) {
+  if (result.rows_ != cols_ || result.cols_ != rows_ ||
+      result.tile_size_ != tile_size_ || &result == this) {
+    throw std::exception();
+  }
+  for (int tr = 0; tr < tile_rows_; ++tr) {
+    for (int tc = 0; tc < tile_cols_; ++tc) {
+      if (tc + 1 < tile_cols_) {
+        Prefetch(tr, tc + 1);
+      } else if (tr + 1 < tile_rows_) {
+        Prefetch(tr + 1, 0);
+      }
+      result.SetTile(tc, tr, GetTile(tr, tc).Transpose());
+    }
+  }
+}
+
+void TiledMatrix::FactorLu() {
+  if (rows_ != cols_) {
+    throw std::exception();
+  }
+  int count = tile_rows_;
+  for (int k = 0; k < count; ++k) {
+    Matrix diagonal = GetTile(k, k);
+    Matrix::FactorTile(diagonal);
+    SetTile(k, k, diagonal);
+    for (int j = k + 1; j < count; ++j) {
+      if (j + 1 < count) Prefetch(k, j + 1);
+      Matrix tile = GetTile(k, j);
+      Matrix::SolveLowerUnit(diagonal, tile);
+      SetTile(k, j, tile);
+    }
+    for (int i = k + 1; i < count; ++i) {
+      if (i + 1 < count) Prefetch(i + 1, k);
+      Matrix tile = GetTile(i, k);
+      Matrix::SolveUpper(diagonal, tile);
+      SetTile(i, k, tile);
+    }
+    // trailing update A(i, j) -= L(i, k) * U(k, j)
+    for (int i = k + 1; i < count; ++i) {
+      Matrix lower = GetTile(i, k);
+      for (int j = k + 1; j < count; ++j) {
+        if (j + 1 < count) {
+          Prefetch(i, j + 1);
+          Prefetch(k, j + 1);
+        } else if (i + 1 < count) {
+          Prefetch(i + 1, k);
+          Prefetch(i + 1, k + 1);
+        }
+        Matrix tile = GetTile(i, j);
+        tile -= lower * GetTile(k, j);
+        SetTile(i, j, tile);
+      }
+    }
+  }
+}
+
+int TiledMatrix::GetRows() const { return rows_; }
+
+int TiledMatrix::GetCols() const { return cols_; }
+
+int TiledMatrix::GetTileSize() const { return tile_size_; }
+
+int TiledMatrix::GetTileRows() const { return tile_rows_; }
+
+int TiledMatrix::GetTileCols() const { return tile_cols_; }
+
+size_t TiledMatrix::GetCacheHits() const { return hits_; }
+
+size_t TiledMatrix::GetCacheMisses() const { return misses_; }
+
+Matrix TiledMatrix::ReadTile(int tile_row, int tile_col) const {
+  int height = std::min(tile_size_, rows_ - tile_row * tile_size_);
+  int width = std::min(tile_size_, cols_ - tile_col * tile_size_);
+  Matrix tile(height, width, Matrix::Allocation::kHeap);
+  char* buffer = reinterpret_cast<char*>(tile.matrix_[0]);
+  size_t bytes = TileBytes(tile_row, tile_col);
+  off_t offset = (static_cast<off_t>(tile_row) * tile_cols_ + tile_col) *
+                 tile_size_ * tile_size_ * sizeof(double);
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t count = pread(fd_, buffer + done, bytes - done, offset + done);
+    if (count <= 0) {
+      throw std::exception();
+    }
+    done += count;
+  }
+  return tile;
+}
+
+void TiledMatrix::WriteTile(int tile_row, int tile_col,
+                            const Matrix& tile) const {
+  // rows of a tile with spare column capacity are not back to back
+  Matrix packed =
+      tile.storage_->col_capacity == tile.cols_ ? tile : tile.Clone();
+  const char* buffer = reinterpret_cast<const char*>(packed.matrix_[0]);
+  size_t bytes = TileBytes(tile_row, tile_col);
+  off_t offset = (static_cast<off_t>(tile_row) * tile_cols_ + tile_col) *
+                 tile_size_ * tile_size_ * sizeof(double);
+  size_t done = 0;
+  while (done < bytes) {
+    ssize_t count = pwrite(fd_, buffer + done, bytes - done, offset + done);
+    if (count <= 0) {
+      throw std::exception();
+    }
+    done += count;
+  }
+}
+
+TiledMatrix::CachedTile& TiledMatrix::Fetch(int tile_row, int tile_col) {
+  CheckTile(tile_row, tile_col);
+  Key key(tile_row, tile_col);
+  auto found = cache_.find(key);
+  if (found != cache_.end()) {
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, found->second.position);
+    return found->second;
+  }
+  ++misses_;
+  Matrix tile;
+  auto pending = pending_.find(key);
+  if (pending != pending_.end()) {
+    // the read is settled here even if it failed, so the charge is
+    // released exactly once
+    std::shared_future<Matrix> read = std::move(pending->second);
+    pending_.erase(pending);
+    cached_bytes_ -= TileBytes(tile_row, tile_col);
+    tile = read.get();
+  } else {
+    tile = ReadTile(tile_row, tile_col);
+  }
+  Insert(key, std::move(tile), false);
+  return cache_.at(key);
+}
+
+void TiledMatrix::Insert(const Key& key, Matrix&& tile, bool dirty) {
+  Evict(TileBytes(key.first, key.second));
+  lru_.push_front(key);
+  cache_.emplace(key, CachedTile{std::move(tile), dirty, lru_.begin()});
+  cached_bytes_ += TileBytes(key.first, key.second);
+}
+
+void TiledMatrix::Evict(size_t bytes) {
+  while (!lru_.empty() && cached_bytes_ + bytes > memory_budget_) {
+    Key key = lru_.back();
+    CachedTile& victim = cache_.at(key);
+    if (victim.dirty) WriteTile(key.first, key.second, victim.tile);
+    cached_bytes_ -= TileBytes(key.first, key.second);
+    cache_.erase(key);
+    lru_.pop_back();
+  }
+}
+
+void TiledMatrix::CheckTile(int tile_row, int tile_col) const {
+  if (tile_row < 0 || tile_row >= tile_rows_ || tile_col < 0 ||
+      tile_col >= tile_cols_) {
+    throw std::exception();
+  }
+}
+
+size_t TiledMatrix::TileBytes(int tile_row, int tile_col) const {
+  size_t height = std::min(tile_size_, rows_ - tile_row * tile_size_);
+  size_t width = std::min(tile_size_, cols_ - tile_col * tile_size_);
+  return height * width * sizeof(double);
+}
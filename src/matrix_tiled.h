@@ -0,0 +1,81 @@
+#ifndef SRC_MATRIX_TILED_H
+#define SRC_MATRIX_TILED_H
+
+#include <future>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "matrix_oop.h"
+
+// disk-backed matrix split into square tiles, at most memory_budget bytes of
+// tiles are kept in an LRU cache and written back to the file on eviction
+class TiledMatrix {
+ public:
+  // constructors, an existing file keeps its contents and must have the
+  // size of this geometry
+  TiledMatrix(const std::string& path, int rows, int cols, int tile_size,
+              size_t memory_budget);
+  TiledMatrix(const TiledMatrix& other) = delete;
+  TiledMatrix& operator=(const TiledMatrix& other) = delete;
+
+  // destructor
+  ~TiledMatrix();
+
+  // tile access
+  Matrix GetTile(int tile_row, int tile_col);
+  void SetTile(int tile_row, int tile_col, const Matrix& tile);
+  void Prefetch(int tile_row, int tile_col);
+  void Flush();
+
+  // conversions
+  void Load(const Matrix& matrix);
+  Matrix ToMatrix();
+
+  // operations, LU is stored in place as unit lower L and upper U without
+  // pivoting
+  static void Multiply(TiledMatrix& left, TiledMatrix& right,
+                       TiledMatrix& result);
+  void Transpose(TiledMatrix& result);
+  void FactorLu();
+
+  // accessors
+  int GetRows() const;
+  int GetCols() const;
+  int GetTileSize() const;
+  int GetTileRows() const;
+  int GetTileCols() const;
+  size_t GetCacheHits() const;
+  size_t GetCacheMisses() const;
+
+ private:
+  using Key = std::pair<int, int>;
+
+  struct CachedTile {
+    Matrix tile;
+    bool dirty;
+    std::list<Key>::iterator position;
+  };
+
+  Matrix ReadTile(int tile_row, int tile_col) const;
+  void WriteTile(int tile_row, int tile_col, const Matrix& tile) const;
+  CachedTile& Fetch(int tile_row, int tile_col);
+  void Insert(const Key& key, Matrix&& tile, bool dirty);
+  void Evict(size_t bytes);
+  void CheckTile(int tile_row, int tile_col) const;
+  size_t TileBytes(int tile_row, int tile_col) const;
+
+  // data members
+  int rows_, cols_, tile_size_;
+  int tile_rows_, tile_cols_;
+  // cached_bytes_ counts cached tiles and tiles being prefetched
+  size_t memory_budget_, cached_bytes_;
+  size_t hits_, misses_;
+  int fd_;
+  std::map<Key, CachedTile> cache_;
+  std::list<Key> lru_;
+  std::map<Key, std::shared_future<Matrix>> pending_;
+};
+
+#endif  // SRC_MATRIX_TILED_H
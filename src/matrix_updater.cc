@@ -0,0 +1,161 @@
+#include "matrix_updater.h"
+
+namespace {
+
+// below this magnitude of 1 + v^T A^-1 u an update is treated as singular
+const double kSingularUpdate = 1e-12;
+
+}  // namespace
+
+InverseUpdater::InverseUpdater(const Matrix& matrix, int refactor_interval)
+    : current_(matrix),
+      inverse_(),
+      determinant_(0),
+      refactor_interval_(refactor_interval),
+      updates_(0) {
+  if (matrix.rows_ != matrix.cols_ || refactor_interval <= 0) {
+    throw std::exception();
+  }
+  Refactor();
+}
+
+void InverseUpdater::SetElement(int row, int col, double value) {
+  int n = current_.rows_;
+  if (row < 0 || row >= n || col < 0 || col >= n) {
+    throw std::exception();
+  }
+  std::vector<double> u(n, 0), v(n, 0);
+  u[row] = value - current_.matrix_[row][col];
+  v[col] = 1;
+  if (u[row] != 0) UpdateRankOne(u, v);
+}
+
+void InverseUpdater::SetRow(int row, const Matrix& values) {
+  int n = current_.rows_;
+  if (row < 0 || row >= n || values.rows_ != 1 || values.cols_ != n) {
+    throw std::exception();
+  }
+  std::vector<double> u(n, 0), v(n);
+  u[row] = 1;
+  for (int j = 0; j < n; ++j) {
+    v[j] = values.matrix_[0][j] - current_.matrix_[row][j];
+  }
+  UpdateRankOne(u, v);
+}
+
+void InverseUpdater::SetCol(int col, const Matrix& values) {
+  int n = current_.rows_;
+  if (col < 0 || col >= n || values.rows_ != n || values.cols_ != 1) {
+    throw std::exception();
+  }
+  std::vector<double> u(n), v(n, 0);
+  for (int i = 0; i < n; ++i) {
+    u[i] = values.matrix_[i][0] - current_.matrix_[i][col];
+  }
+  v[col] = 1;
+  UpdateRankOne(u, v);
+}
+
+void InverseUpdater::Update(const Matrix& u, const Matrix& v) {
+  int n = current_.rows_;
+  int k = u.cols_;
+  if (u.rows_ != n || v.rows_ != n || v.cols_ != k) {
+    throw std::exception();
+  }
+  if (k == 1) {
+    std::vector<double> column_u(n), column_v(n);
+    for (int i = 0; i < n; ++i) {
+      column_u[i] = u.matrix_[i][0];
+      column_v[i] = v.matrix_[i][0];
+    }
+    UpdateRankOne(column_u, column_v);
+    return;
+  }
+  // Woodbury: (A + U V^T)^-1 = A^-1 - A^-1 U S^-1 V^T A^-1 with
+  // S = I + V^T A^-1 U, and det(A + U V^T) = det(A) * det(S)
+  Matrix v_transpose = v.Transpose();
+  Matrix updated = current_ + u * v_transpose;
+  Matrix left = Matrix::MultiplyChain({inverse_, u});
+  Matrix right = Matrix::MultiplyChain({v_transpose, inverse_});
+  Matrix capacitance = Matrix::MultiplyChain({v_transpose, left});
+  for (int i = 0; i < k; ++i) capacitance.matrix_[i][i] += 1;
+  double factor = capacitance.Determinant();
+  if (std::fabs(factor) < kSingularUpdate) {
+    Factor(updated);
+    return;
+  }
+  Matrix correction = capacitance.Solve(right);
+  inverse_ -= Matrix::MultiplyChain({left, correction});
+  current_ = std::move(updated);
+  determinant_ *= factor;
+  if (++updates_ >= refactor_interval_) Refactor();
+}
+
+void InverseUpdater::Refactor() { Factor(current_); }
+
+Matrix InverseUpdater::GetMatrix() const { return current_; }
+
+Matrix InverseUpdater::GetInverse() const { return inverse_; }
+
+double InverseUpdater::GetDeterminant() const { return determinant_; }
+
+void InverseUpdater::UpdateRankOne(const std::vector<double>& u,
+                                   const std::vector<double>& v) {
+  // Sherman-Morrison with x = A^-1 u and y^T = v^T A^-1, zero entries of u
+  // and v are skipped so element, row and column changes stay cheap
+  int n = current_.rows_;
+  std::vector<int> u_nonzero, v_nonzero;
+  for (int i = 0; i < n; ++i) {
+    if (u[i] != 0) u_nonzero.push_back(i);
+    if (v[i] != 0) v_nonzero.push_back(i);
+  }
+  Matrix updated = current_.Clone();
+  for (int i : u_nonzero) {
+    for (int j : v_nonzero) updated.matrix_[i][j] += u[i] * v[j];
+  }
+  double** inverse = inverse_.matrix_;
+  std::vector<double> x(n, 0), y(n, 0);
+  for (int i = 0; i < n; ++i) {
+    for (int k : u_nonzero) x[i] += inverse[i][k] * u[k];
+  }
+  for (int k : v_nonzero) {
+    for (int j = 0; j < n; ++j) y[j] += v[k] * inverse[k][j];
+  }
+  double denominator = 1;
+  for (int k : v_nonzero) denominator += v[k] * x[k];
+  if (std::fabs(denominator) < kSingularUpdate) {
+    Factor(updated);
+    return;
+  }
+  current_ = std::move(updated);
+  inverse_.Detach();
+  inverse = inverse_.matrix_;
+  for (int i = 0; i < n; ++i) {
+    double scale = x[i] / denominator;
+    if (scale == 0) continue;
+    for (int j = 0; j < n; ++j) inverse[i][j] -= scale * y[j];
+  }
+  determinant_ *= denominator;
+  if (++updates_ >= refactor_interval_) Refactor();
+}
+
+void InverseUpdater::Factor(const Matrix& matrix) {
+  // nothing changes if the matrix turns out to be singular
+  int n = matrix.rows_;
+  Matrix identity(n, n);
+  for (int i = 0; i < n; ++i) identity.matrix_[i][i] = 1;
+  std::vector<double> lu;
+  std::vector<int> pivots;
+  matrix.Factorize(lu, pivots);
+  Matrix inverse = Matrix::SolveFactorized(lu, pivots, identity);
+  // the determinant is the product of the U diagonal, negated per swap
+  double determinant = 1;
+  for (int i = 0; i < n; ++i) {
+    determinant *= lu[static_cast<size_t>(i) * n + i];
+    if (pivots[i] != i) determinant = -determinant;
+  }
+  determinant_ = determinant;
+  inverse_ = std::move(inverse);
+  current_ = matrix;
+  updates_ = 0;
+}
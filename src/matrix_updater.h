@@ -0,0 +1,40 @@
+#ifndef SRC_MATRIX_UPDATER_H
+#define SRC_MATRIX_UPDATER_H
+
+#include <vector>
+
+#include "matrix_oop.h"
+
+// keeps the inverse and the determinant of a square matrix up to date under
+// low-rank modifications in O(n^2 * k), the inverse is recomputed from an LU
+// factorization every refactor_interval updates to bound the rounding error
+class InverseUpdater {
+ public:
+  explicit InverseUpdater(const Matrix& matrix, int refactor_interval = 64);
+
+  // modifications
+  void SetElement(int row, int col, double value);
+  void SetRow(int row, const Matrix& values);
+  void SetCol(int col, const Matrix& values);
+  void Update(const Matrix& u, const Matrix& v);
+  void Refactor();
+
+  // accessors
+  Matrix GetMatrix() const;
+  Matrix GetInverse() const;
+  double GetDeterminant() const;
+
+ private:
+  void UpdateRankOne(const std::vector<double>& u,
+                     const std::vector<double>& v);
+  void Factor(const Matrix& matrix);
+
+  // data members
+  Matrix current_;
+  Matrix inverse_;
+  double determinant_;
+  int refactor_interval_;
+  int updates_;
+};
+
+#endif  // SRC_MATRIX_UPDATER_H